@@ -0,0 +1,652 @@
+/*
+ * coprocpump: stream data through a coprocess, pools of coprocesses
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+/* capacity requested for the coprocess pipes (the default is 64KiB).
+	 The limit for unprivileged users is /proc/sys/fs/pipe-max-size */
+#define COPROC_PIPESIZE (1024 * 1024)
+/* buffer used when splice cannot be used */
+#define COPROC_CHUNK (64 * 1024)
+
+struct coproc_pump_t {
+	/* input: infd or inbuf/inlen */
+	int infd;
+	const char *inbuf;
+	size_t inlen;
+	/* output: outfd or *outbuf (outsize is its capacity) or nothing */
+	int outfd;
+	char **outbuf;
+	size_t outlen;
+	size_t outsize;
+	/* 1 while splice works for infd, outfd */
+	int insplice;
+	int outsplice;
+	/* pending data read from infd when splice cannot be used */
+	char *chunk;
+	size_t chunkpos;
+	size_t chunklen;
+};
+
+static void coproc_setpipesz(int fd) {
+	int size=fcntl(fd, F_GETPIPE_SZ);
+	/* it is just a hint: the default size is kept if the request fails */
+	if (size >= 0 && size < COPROC_PIPESIZE)
+		fcntl(fd, F_SETPIPE_SZ, COPROC_PIPESIZE);
+}
+
+static int coproc_nonblock(int fd) {
+	int flags=fcntl(fd, F_GETFL);
+	if (flags < 0)
+		return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* a coprocess may close its stdin before reading all the input:
+	 SIGPIPE is blocked and, unless it was already pending, consumed by
+	 coproc_sigpipe_restore */
+static int coproc_sigpipe_block(sigset_t *oldset) {
+	sigset_t pipeset, pending;
+	sigemptyset(&pipeset);
+	sigaddset(&pipeset, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeset, oldset);
+	sigpending(&pending);
+	return sigismember(&pending, SIGPIPE);
+}
+
+static void coproc_sigpipe_restore(const sigset_t *oldset, int pipepending) {
+	if (!pipepending) {
+		sigset_t pipeset;
+		struct timespec zero={0, 0};
+		sigemptyset(&pipeset);
+		sigaddset(&pipeset, SIGPIPE);
+		while (sigtimedwait(&pipeset, NULL, &zero) >= 0)
+			;
+	}
+	pthread_sigmask(SIG_SETMASK, oldset, NULL);
+}
+
+/* write all the buffer to a (possibly blocking) file descriptor */
+static int coproc_writeall(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n=write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf+=n;
+		len-=n;
+	}
+	return 0;
+}
+
+/* feed the coprocess (fd is its stdin, it is writable).
+	 returns 1 if there is more input, 0 at EOF, -1 in case of error.
+	 The pipe is O_NONBLOCK unless data is spliced from infd: it never blocks */
+static int coproc_feed(struct coproc_pump_t *p, int fd) {
+	ssize_t n;
+	if (p->infd >= 0 && p->insplice) {
+		n=splice(p->infd, NULL, fd, NULL, COPROC_PIPESIZE, SPLICE_F_MOVE);
+		if (n > 0)
+			return 1;
+		if (n == 0)
+			return 0;
+		if (errno != EINVAL && errno != ENOSYS)
+			return (errno == EINTR || errno == EAGAIN) ? 1 : -1;
+		/* infd does not support splice: use read/write */
+		p->insplice=0;
+		if ((p->chunk=malloc(COPROC_CHUNK)) == NULL || coproc_nonblock(fd) < 0)
+			return -1;
+	}
+	if (p->infd >= 0) {
+		if (p->chunkpos == p->chunklen) {
+			n=read(p->infd, p->chunk, COPROC_CHUNK);
+			if (n <= 0)
+				return (n == 0) ? 0 : (errno == EINTR) ? 1 : -1;
+			p->chunkpos=0;
+			p->chunklen=n;
+		}
+		n=write(fd, p->chunk + p->chunkpos, p->chunklen - p->chunkpos);
+		if (n > 0)
+			p->chunkpos+=n;
+	} else {
+		if (p->inlen == 0)
+			return 0;
+		n=write(fd, p->inbuf, p->inlen);
+		if (n > 0) {
+			p->inbuf+=n;
+			p->inlen-=n;
+		}
+	}
+	if (n < 0 && errno != EINTR && errno != EAGAIN)
+		return -1;
+	return 1;
+}
+
+/* drain the coprocess (fd is its stdout, it is readable).
+	 returns 1 if the coprocess can produce more output, 0 at EOF, -1 in case of error */
+static int coproc_drain(struct coproc_pump_t *p, int fd) {
+	ssize_t n;
+	if (p->outfd >= 0 && p->outsplice) {
+		n=splice(fd, NULL, p->outfd, NULL, COPROC_PIPESIZE, SPLICE_F_MOVE);
+		if (n > 0)
+			p->outlen+=n;
+		if (n >= 0)
+			return n > 0;
+		if (errno != EINVAL && errno != ENOSYS)
+			return (errno == EINTR || errno == EAGAIN) ? 1 : -1;
+		/* e.g. outfd has O_APPEND: use read/write */
+		p->outsplice=0;
+	}
+	if (p->outbuf) {
+		/* one more byte for the trailing NUL */
+		if (p->outsize - p->outlen < COPROC_CHUNK + 1) {
+			size_t newsize=p->outsize ? 2 * p->outsize : 2 * COPROC_CHUNK;
+			char *newbuf=realloc(*p->outbuf, newsize);
+			if (newbuf == NULL)
+				return -1;
+			*p->outbuf=newbuf;
+			p->outsize=newsize;
+		}
+		n=read(fd, *p->outbuf + p->outlen, p->outsize - p->outlen - 1);
+	} else {
+		if (p->chunk == NULL && (p->chunk=malloc(COPROC_CHUNK)) == NULL)
+			return -1;
+		n=read(fd, p->chunk, COPROC_CHUNK);
+		if (n > 0 && p->outfd >= 0 && coproc_writeall(p->outfd, p->chunk, n) < 0)
+			return -1;
+	}
+	if (n > 0)
+		p->outlen+=n;
+	if (n >= 0)
+		return n > 0;
+	return (errno == EINTR || errno == EAGAIN) ? 1 : -1;
+}
+
+ssize_t coprocess_pump(int pipefd[2], int infd, const void *inbuf, size_t inlen,
+		int outfd, char **outbuf, size_t *outlen) {
+	struct coproc_pump_t p={infd, inbuf, inlen, outfd, (outfd < 0) ? outbuf : NULL, 0, 0, 1, 1};
+	/* pfd[0]: coprocess stdout, pfd[1]: coprocess stdin */
+	struct pollfd pfd[2]={{pipefd[0], POLLIN, 0}, {pipefd[1], POLLOUT, 0}};
+	sigset_t oldset;
+	int pipepending;
+	int errno_save;
+	int rv=0;
+	if (p.outbuf)
+		*p.outbuf=NULL;
+	/* EPIPE is not an error */
+	pipepending=coproc_sigpipe_block(&oldset);
+	coproc_setpipesz(pipefd[0]);
+	coproc_setpipesz(pipefd[1]);
+	if (infd < 0 && coproc_nonblock(pipefd[1]) < 0)
+		rv=-1;
+	if (infd < 0 && inbuf == NULL) {
+		close(pipefd[1]);
+		pfd[1].fd=-1;
+	}
+	while (rv == 0 && (pfd[0].fd >= 0 || pfd[1].fd >= 0)) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno != EINTR)
+				rv=-1;
+			continue;
+		}
+		if (pfd[1].revents) {
+			int more=coproc_feed(&p, pfd[1].fd);
+			if (more < 0 && errno != EPIPE)
+				rv=-1;
+			if (more <= 0) {
+				close(pfd[1].fd);
+				pfd[1].fd=-1;
+			}
+		}
+		if (pfd[0].revents) {
+			int more=coproc_drain(&p, pfd[0].fd);
+			if (more < 0)
+				rv=-1;
+			if (more == 0) {
+				close(pfd[0].fd);
+				pfd[0].fd=-1;
+			}
+		}
+	}
+	errno_save=errno;
+	if (pfd[0].fd >= 0)
+		close(pfd[0].fd);
+	if (pfd[1].fd >= 0)
+		close(pfd[1].fd);
+	coproc_sigpipe_restore(&oldset, pipepending);
+	free(p.chunk);
+	if (p.outbuf) {
+		if (rv < 0) {
+			free(*p.outbuf);
+			*p.outbuf=NULL;
+		} else if (*p.outbuf != NULL)
+			(*p.outbuf)[p.outlen]=0;
+		else if ((*p.outbuf=calloc(1, 1)) == NULL)
+			return -1;
+	}
+	if (rv < 0)
+		return errno=errno_save, -1;
+	if (outlen)
+		*outlen=p.outlen;
+	return p.outlen;
+}
+
+/* pools of coprocesses: idle workers are kept in a LIFO list, so the
+	 workers idle for the longest time are at its tail */
+/* idle workers beyond minworkers are retired after COPROC_POOL_IDLE ms */
+#define COPROC_POOL_IDLE 5000
+/* retired workers have COPROC_POOL_GRACE ms to terminate after EOF */
+#define COPROC_POOL_GRACE 100
+
+struct coproc_worker {
+	pid_t pid;
+	int pipefd[2];
+	/* data read from the worker and not returned yet */
+	char *buf;
+	size_t len;
+	size_t size;
+	long long lastuse;
+	long long deadline; // retired workers get killed at their deadline
+	struct coproc_worker *next;
+};
+
+struct coprocess_pool {
+	char *path;
+	char *command;
+	int framing;
+	int flags;
+	int minworkers;
+	int maxworkers;
+	int nworkers; // idle, busy or being started
+	int ncalls; // calls in progress (also waiting for a worker)
+	int freeing; // coprocess_pool_free is waiting for the calls in progress
+	struct coproc_worker *idle;
+	struct coproc_worker *retired; // closed, not reaped yet
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static long long coproc_clock_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/* workers terminate at EOF: all the pipes are closed first, then the
+	 workers which do not terminate in time get killed */
+static void coproc_workers_free(struct coproc_worker *list) {
+	struct coproc_worker *w;
+	long long deadline=coproc_clock_ms() + COPROC_POOL_GRACE;
+	for (w=list; w; w=w->next) {
+		if (w->pipefd[0] >= 0) {
+			close(w->pipefd[0]);
+			close(w->pipefd[1]);
+		}
+	}
+	while ((w=list) != NULL) {
+		while (waitpid(w->pid, NULL, WNOHANG) == 0) {
+			if (coproc_clock_ms() >= deadline) {
+				kill(w->pid, SIGKILL);
+				waitpid(w->pid, NULL, 0);
+				break;
+			}
+			nanosleep(&(struct timespec) {0, 1000000}, NULL);
+		}
+		list=w->next;
+		free(w->buf);
+		free(w);
+	}
+}
+
+/* retired workers are not waited for by coproc_pool_put (it is on the path
+	 of each call): the pipes are closed at once, then the workers are reaped
+	 by the following calls. The list of the workers still running is
+	 returned, those running beyond their deadline get killed */
+static struct coproc_worker *coproc_workers_reap(struct coproc_worker *list, long long now) {
+	struct coproc_worker *running=NULL;
+	while (list != NULL) {
+		struct coproc_worker *w=list;
+		list=w->next;
+		if (waitpid(w->pid, NULL, WNOHANG) == 0) {
+			if (now < w->deadline) {
+				w->next=running;
+				running=w;
+				continue;
+			}
+			kill(w->pid, SIGKILL);
+			waitpid(w->pid, NULL, 0);
+		}
+		free(w->buf);
+		free(w);
+	}
+	return running;
+}
+
+static struct coproc_worker *coproc_worker_new(struct coprocess_pool *pool) {
+	struct coproc_worker *w=calloc(1, sizeof(*w));
+	if (w == NULL)
+		return NULL;
+	w->pid=_coprocess_common(pool->path, pool->command, NULL, environ, w->pipefd, pool->flags);
+	if (w->pid == -1) {
+		free(w);
+		return NULL;
+	}
+	coproc_setpipesz(w->pipefd[0]);
+	coproc_setpipesz(w->pipefd[1]);
+	if (coproc_nonblock(w->pipefd[0]) < 0 || coproc_nonblock(w->pipefd[1]) < 0) {
+		int errno_save=errno;
+		coproc_workers_free(w);
+		errno=errno_save;
+		return NULL;
+	}
+	return w;
+}
+
+/* an idle worker, or a new one if there are less than maxworkers */
+static struct coproc_worker *coproc_pool_get(struct coprocess_pool *pool) {
+	struct coproc_worker *w;
+	pthread_mutex_lock(&pool->mutex);
+	while ((w=pool->idle) == NULL && pool->nworkers >= pool->maxworkers && !pool->freeing)
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+	if (pool->freeing) {
+		pthread_mutex_unlock(&pool->mutex);
+		return errno=ECANCELED, NULL;
+	}
+	if (w != NULL) {
+		pool->idle=w->next;
+		pthread_mutex_unlock(&pool->mutex);
+		return w;
+	}
+	pool->nworkers++;
+	pthread_mutex_unlock(&pool->mutex);
+	if ((w=coproc_worker_new(pool)) == NULL) {
+		int errno_save=errno;
+		pthread_mutex_lock(&pool->mutex);
+		pool->nworkers--;
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+		errno=errno_save;
+	}
+	return w;
+}
+
+/* give back a worker (ok == 0: the worker failed, it gets discarded).
+	 While the pool is being freed all the workers given back are retired */
+static void coproc_pool_put(struct coprocess_pool *pool, struct coproc_worker *w, int ok) {
+	struct coproc_worker *retired=NULL;
+	struct coproc_worker *pending;
+	long long now=coproc_clock_ms();
+	pthread_mutex_lock(&pool->mutex);
+	if (ok && !pool->freeing) {
+		struct coproc_worker **scan;
+		w->lastuse=now;
+		w->next=pool->idle;
+		pool->idle=w;
+		for (scan=&pool->idle; *scan && (*scan)->lastuse + COPROC_POOL_IDLE > now; scan=&(*scan)->next)
+			;
+		while (*scan && pool->nworkers > pool->minworkers) {
+			struct coproc_worker *old=*scan;
+			*scan=old->next;
+			old->next=retired;
+			retired=old;
+			pool->nworkers--;
+		}
+	} else {
+		w->next=NULL;
+		retired=w;
+		pool->nworkers--;
+	}
+	pending=pool->retired;
+	pool->retired=NULL;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	if (retired || pending) {
+		struct coproc_worker **tail=&retired;
+		for (; *tail; tail=&(*tail)->next) {
+			close((*tail)->pipefd[0]);
+			close((*tail)->pipefd[1]);
+			(*tail)->pipefd[0]=(*tail)->pipefd[1]=-1;
+			(*tail)->deadline=now + COPROC_POOL_GRACE;
+		}
+		*tail=pending;
+		if ((retired=coproc_workers_reap(retired, now)) != NULL) {
+			pthread_mutex_lock(&pool->mutex);
+			for (tail=&retired; *tail; tail=&(*tail)->next)
+				;
+			*tail=pool->retired;
+			pool->retired=retired;
+			pthread_mutex_unlock(&pool->mutex);
+		}
+	}
+}
+
+static void coproc_pool_enter(struct coprocess_pool *pool) {
+	pthread_mutex_lock(&pool->mutex);
+	pool->ncalls++;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/* the last call in progress wakes up coprocess_pool_free */
+static void coproc_pool_leave(struct coprocess_pool *pool) {
+	pthread_mutex_lock(&pool->mutex);
+	if (--pool->ncalls == 0 && pool->freeing)
+		pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/* the length of the frame at the beginning of buf, 0 if it is incomplete.
+	 The payload is *datalen bytes long, it starts at buf + *datapos */
+static size_t coproc_frame(int framing, const char *buf, size_t len,
+		size_t *datapos, size_t *datalen) {
+	if (framing == EXECS_POOL_LEN32) {
+		uint32_t n;
+		if (len < sizeof(n))
+			return 0;
+		memcpy(&n, buf, sizeof(n));
+		n=ntohl(n);
+		if (len - sizeof(n) < n)
+			return 0;
+		*datapos=sizeof(n);
+		*datalen=n;
+		return sizeof(n) + n;
+	} else {
+		const char *nl=memchr(buf, '\n', len);
+		if (nl == NULL)
+			return 0;
+		*datapos=0;
+		*datalen=nl - buf;
+		return *datalen + 1;
+	}
+}
+
+/* send the request and wait for the response (EPIPE: the worker terminated) */
+static ssize_t coproc_exchange(struct coprocess_pool *pool, struct coproc_worker *w,
+		const char *req, size_t reqlen, char **resp) {
+	uint32_t hdr=htonl(reqlen);
+	struct iovec iov[3]={
+		{&hdr, (pool->framing == EXECS_POOL_LEN32) ? sizeof(hdr) : 0},
+		{(void *) req, reqlen},
+		{"\n", (pool->framing == EXECS_POOL_LINE &&
+				(reqlen == 0 || req[reqlen - 1] != '\n')) ? 1 : 0}};
+	struct iovec *iovp=iov;
+	int iovcnt=3;
+	struct pollfd pfd[2]={{w->pipefd[0], POLLIN, 0}, {w->pipefd[1], POLLOUT, 0}};
+	size_t framelen;
+	size_t datapos;
+	size_t datalen;
+	while (pfd[1].fd >= 0 ||
+			(framelen=coproc_frame(pool->framing, w->buf, w->len, &datapos, &datalen)) == 0) {
+		ssize_t n;
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (pfd[1].revents) {
+			if ((n=writev(pfd[1].fd, iovp, iovcnt)) < 0) {
+				if (errno != EINTR && errno != EAGAIN)
+					return -1;
+				n=0;
+			}
+			while (iovcnt > 0 && (size_t) n >= iovp->iov_len) {
+				n-=iovp->iov_len;
+				iovp++;
+				iovcnt--;
+			}
+			if (iovcnt > 0) {
+				iovp->iov_base=(char *) iovp->iov_base + n;
+				iovp->iov_len-=n;
+			} else
+				pfd[1].fd=-1;
+		}
+		if (pfd[0].revents) {
+			if (w->size - w->len < COPROC_CHUNK) {
+				size_t newsize=w->size ? 2 * w->size : COPROC_CHUNK;
+				char *newbuf;
+				while (newsize - w->len < COPROC_CHUNK)
+					newsize*=2;
+				if ((newbuf=realloc(w->buf, newsize)) == NULL)
+					return -1;
+				w->buf=newbuf;
+				w->size=newsize;
+			}
+			n=read(pfd[0].fd, w->buf + w->len, w->size - w->len);
+			if (n == 0)
+				return errno=EPIPE, -1;
+			if (n < 0) {
+				if (errno != EINTR && errno != EAGAIN)
+					return -1;
+			} else
+				w->len+=n;
+		}
+	}
+	if (resp) {
+		if ((*resp=malloc(datalen + 1)) == NULL)
+			return -1;
+		memcpy(*resp, w->buf + datapos, datalen);
+		(*resp)[datalen]=0;
+	}
+	w->len-=framelen;
+	memmove(w->buf, w->buf + framelen, w->len);
+	return datalen;
+}
+
+struct coprocess_pool *_coprocess_pool_new(const char *path, const char *command,
+		int framing, int minworkers, int maxworkers, int flags) {
+	struct coprocess_pool *pool;
+	int i;
+	if (command == NULL || (framing != EXECS_POOL_LINE && framing != EXECS_POOL_LEN32) ||
+			minworkers < 0 || maxworkers < 1 || minworkers > maxworkers)
+		return errno=EINVAL, NULL;
+	if ((pool=calloc(1, sizeof(*pool))) == NULL)
+		return NULL;
+	pool->framing=framing;
+	pool->flags=flags;
+	pool->minworkers=minworkers;
+	pool->maxworkers=maxworkers;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	if ((path && (pool->path=strdup(path)) == NULL) ||
+			(pool->command=strdup(command)) == NULL)
+		goto err;
+	for (i=0; i<minworkers; i++) {
+		struct coproc_worker *w=coproc_worker_new(pool);
+		if (w == NULL)
+			goto err;
+		w->lastuse=coproc_clock_ms();
+		w->next=pool->idle;
+		pool->idle=w;
+		pool->nworkers++;
+	}
+	return pool;
+err:
+	i=errno;
+	coprocess_pool_free(pool);
+	errno=i;
+	return NULL;
+}
+
+ssize_t coprocess_pool_call(struct coprocess_pool *pool, const void *req, size_t reqlen,
+		char **resp) {
+	sigset_t oldset;
+	int pipepending;
+	ssize_t rv=-1;
+	int tries;
+	if (pool->framing == EXECS_POOL_LINE ?
+			reqlen > 0 && memchr(req, '\n', reqlen - 1) != NULL : reqlen > UINT32_MAX)
+		return errno=EINVAL, -1;
+	pipepending=coproc_sigpipe_block(&oldset);
+	coproc_pool_enter(pool);
+	/* a worker which terminated (e.g. it crashed) is replaced by a new one,
+		 the request is sent again once */
+	for (tries=0; tries < 2 && rv < 0; tries++) {
+		struct coproc_worker *w=coproc_pool_get(pool);
+		int errno_save;
+		if (w == NULL)
+			break;
+		rv=coproc_exchange(pool, w, req, reqlen, resp);
+		errno_save=errno;
+		coproc_pool_put(pool, w, rv >= 0);
+		errno=errno_save;
+		if (rv < 0 && errno != EPIPE)
+			break;
+	}
+	tries=errno;
+	coproc_pool_leave(pool);
+	coproc_sigpipe_restore(&oldset, pipepending);
+	errno=tries;
+	return rv;
+}
+
+/* busy workers are reclaimed when their calls complete: the threads waiting
+	 for a worker give up, the workers given back are retired */
+void coprocess_pool_free(struct coprocess_pool *pool) {
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock(&pool->mutex);
+	pool->freeing=1;
+	pthread_cond_broadcast(&pool->cond);
+	while (pool->ncalls > 0)
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+	coproc_workers_free(pool->idle);
+	coproc_workers_free(pool->retired);
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->cond);
+	free(pool->path);
+	free(pool->command);
+	free(pool);
+}
@@ -22,9 +22,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <execs.h>
 
-//char *sn[] = { "END", "SPACE", "CHAR", "SGLQ", "DBLQ", "ESCAPE", "SEMIC", "VAR", "ESCVAR", "DBLESC" };
+//char *sn[] = { "END", "SPACE", "CHAR", "SGLQ", "DBLQ", "ESCAPE", "SEMIC", "VAR", "PIPE", "REDIR", "AMP", "ESCVAR", "DBLESC" };
 #define END 0
 #define SPACE 1
 #define CHAR 2
@@ -33,9 +42,19 @@
 #define ESCAPE 5 // escape '\'
 #define SEMIC 6 // semicolon ;
 #define VAR 7 // $name
-#define ESCVAR 8 // '\' in variable name
-#define DBLESC 9 // '\' in double quoted text
+#define PIPE 8 // pipe |
+#define REDIR 9 // redirection operator: [n]< [n]> [n]>> [n]>& [n]<&
+#define AMP 10 // '&' (a char class only, part of the >& and <& operators)
+#define ESCVAR 11 // '\' in variable name
+#define DBLESC 12 // '\' in double quoted text
 #define NSTATES (DBLESC+1)
+#define NCLASSES (AMP+1)
+/* internal flag of args_fsa: |, <, > and & are ordinary chars, as required
+	 by the functions which cannot apply pipelines or redirections
+	 (s2argv, s2multiargv, execs*) */
+#define FSA_LITERAL 0x100
+#define FSA_CLASS(c, flags) ((charclass[(unsigned char) (c)] >= PIPE && ((flags) & FSA_LITERAL)) ? \
+		CHAR : charclass[(unsigned char) (c)])
 
 #define NEWARG 0x1 // beginning of a new argument
 #define CHCOPY 0x2 // copy the char in current argv
@@ -45,134 +64,438 @@
 
 /* This is the FSA used to get the lexical items of the command line */
 
-static char nextstate[NSTATES][NSTATES-1]= {
-	{END,    0,   0,   0,   0,     0,    0,   0}, // END
-	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR}, // SPACE
-	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC,CHAR}, // CHAR
-	{END, SGLQ,SGLQ,CHAR,SGLQ,  SGLQ, SGLQ,SGLQ}, // SGLQ
-	{END, DBLQ,DBLQ,DBLQ,CHAR,DBLESC, DBLQ,DBLQ}, // DBLQ
-	{END, CHAR,CHAR,CHAR,CHAR,  CHAR, CHAR,CHAR}, // ESCAPE
-	{END,SEMIC,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR}, // SEMIC
-	{END,SPACE, VAR, VAR, VAR,   VAR,SEMIC, VAR}, // VAR
-	{END,  VAR, VAR, VAR, VAR,   VAR,  VAR, VAR}, // ESCVAR
-	{END, DBLQ,DBLQ,DBLQ,DBLQ,  DBLQ, DBLQ,DBLQ}}; // DBLESC
-
-static char action[NSTATES][NSTATES-1]= {
-	{ENDCMD|     0,     0,            0,     0,     0,     0,            0,     0}, //END
-	{ENDCMD|     0,     0,NEWARG|CHCOPY,NEWARG,NEWARG,NEWARG,       ENDCMD,NEWARG}, //SPACE
-	{ENDCMD|ENDARG,ENDARG,       CHCOPY,     0,     0,     0,ENDCMD|ENDARG,     0}, //CHAR
-	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,     0,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //SNGQ
-	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,     0,CHCOPY,       CHCOPY,CHCOPY}, //DBLQ
-	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //ESCAPE
-	{ENDCMD|     0,     0,NEWARG|CHCOPY,NEWARG,NEWARG,NEWARG,            0,NEWARG}, //SEMIC
-	{ENDCMD|ENDVAR,ENDVAR,       CHCOPY,     0,     0,     0,ENDCMD|ENDVAR,     0}, //VAR
-	{ENDCMD|ENDVAR,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //ESCVAR
-	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}}; //DBLESC
+static char nextstate[NSTATES][NCLASSES]= {
+	{END,    0,   0,   0,   0,     0,    0,   0,   0,    0,    0}, // END
+	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // SPACE
+	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC,CHAR,PIPE,REDIR, CHAR}, // CHAR
+	{END, SGLQ,SGLQ,CHAR,SGLQ,  SGLQ, SGLQ,SGLQ,SGLQ, SGLQ, SGLQ}, // SGLQ
+	{END, DBLQ,DBLQ,DBLQ,CHAR,DBLESC, DBLQ,DBLQ,DBLQ, DBLQ, DBLQ}, // DBLQ
+	{END, CHAR,CHAR,CHAR,CHAR,  CHAR, CHAR,CHAR,CHAR, CHAR, CHAR}, // ESCAPE
+	{END,SEMIC,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // SEMIC
+	{END,SPACE, VAR, VAR, VAR,   VAR,SEMIC, VAR,PIPE,REDIR,  VAR}, // VAR
+	{END, PIPE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // PIPE
+	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR,REDIR}, // REDIR
+	{END,    0,   0,   0,   0,     0,    0,   0,   0,    0,    0}, // AMP (not a state)
+	{END,  VAR, VAR, VAR, VAR,   VAR,  VAR, VAR, VAR,  VAR,  VAR}, // ESCVAR
+	{END, DBLQ,DBLQ,DBLQ,DBLQ,  DBLQ, DBLQ,DBLQ,DBLQ, DBLQ, DBLQ}}; // DBLESC
+
+/* the ENDCMD actions entering or leaving the PIPE state check that
+	 the commands of the pipeline are not empty */
+/* ENDARG and ENDVAR take place before NEWARG: a redirection operator and
+	 the preceding (or following) argument can be adjacent */
+static char action[NSTATES][NCLASSES]= {
+	{ENDCMD|     0,     0,            0,            0,            0,            0,            0,            0,            0,            0,            0}, //END
+	{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,       ENDCMD,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //SPACE
+	{ENDCMD|ENDARG,ENDARG,       CHCOPY,            0,            0,            0,ENDCMD|ENDARG,            0,ENDCMD|ENDARG,ENDARG|NEWARG|CHCOPY,CHCOPY}, //CHAR
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,            0,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //SNGQ
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,            0,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //DBLQ
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //ESCAPE
+	{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,            0,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //SEMIC
+	{ENDCMD|ENDVAR,ENDVAR,       CHCOPY,            0,            0,            0,ENDCMD|ENDVAR,            0,ENDCMD|ENDVAR,ENDVAR|NEWARG|CHCOPY,CHCOPY}, //VAR
+	{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,       ENDCMD,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //PIPE
+	{ENDCMD|ENDARG,ENDARG,ENDARG|NEWARG|CHCOPY,ENDARG|NEWARG,ENDARG|NEWARG,ENDARG|NEWARG,ENDCMD|ENDARG,ENDARG|NEWARG,ENDCMD|ENDARG,CHCOPY,CHCOPY}, //REDIR
+	{            0,     0,            0,            0,            0,            0,            0,            0,            0,            0,            0}, //AMP
+	{ENDCMD|ENDVAR,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //ESCVAR
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}}; //DBLESC
+
+/* character classes (the "this" column of the FSA tables) */
+#define __ CHAR
+static const unsigned char charclass[256]= {
+	  END,   __,   __,   __,   __,   __,   __,   __,   __,SPACE,SPACE,   __,   __,   __,   __,   __, // 0x00
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0x10
+	SPACE,   __, DBLQ,   __,  VAR,   __,  AMP, SGLQ,   __,   __,   __,   __,   __,   __,   __,   __, // 0x20
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,SEMIC,REDIR,   __,REDIR,   __, // 0x30
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0x40
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,ESCAPE,  __,   __,   __, // 0x50
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0x60
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, PIPE,   __,   __,   __, // 0x70
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0x80
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0x90
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0xa0
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0xb0
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0xc0
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0xd0
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __, // 0xe0
+	   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __,   __}; // 0xf0
+#undef __
+
+/* In these states a run of chars can be copied in the current argument
+	 with no state change. The run ends at the first char of the stop set (or at
+	 the end of the string). The stop sets must agree with charclass
+	 and the FSA tables */
+static const char *fsa_stopset[NSTATES]= {
+	[CHAR]=" \t\n\"$';\\|<>",
+	[VAR]=" \t\n\"$';\\|<>",
+	[SGLQ]="'",
+	[DBLQ]="\"\\"};
+
+#if defined(__AVX2__)
+#define FSA_VLEN 32
+typedef __m256i fsa_vec;
+#define fsa_load(p) _mm256_load_si256((const __m256i *) (p))
+#define fsa_set1(c) _mm256_set1_epi8(c)
+#define fsa_cmpeq(a, b) _mm256_cmpeq_epi8((a), (b))
+#define fsa_or(a, b) _mm256_or_si256((a), (b))
+#define fsa_movemask(a) ((uint32_t) _mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#define FSA_VLEN 16
+typedef __m128i fsa_vec;
+#define fsa_load(p) _mm_load_si128((const __m128i *) (p))
+#define fsa_set1(c) _mm_set1_epi8(c)
+#define fsa_cmpeq(a, b) _mm_cmpeq_epi8((a), (b))
+#define fsa_or(a, b) _mm_or_si128((a), (b))
+#define fsa_movemask(a) ((uint32_t) _mm_movemask_epi8(a))
+#endif
+
+#ifdef FSA_VLEN
+/* bitmask of the chars of the (aligned) vector at p belonging to stop or NUL */
+__attribute__((no_sanitize_address))
+static inline uint32_t fsa_stopmask(const char *p, const char *stop)
+{
+	fsa_vec v=fsa_load(p);
+	fsa_vec eq=fsa_cmpeq(v, fsa_set1(0));
+	for (; *stop; stop++)
+		eq=fsa_or(eq, fsa_cmpeq(v, fsa_set1(*stop)));
+	return fsa_movemask(eq);
+}
+#endif
+
+/* return the first char of s belonging to stop (or the trailing NUL) */
+/* vector loads are aligned, so they never cross a page boundary even if
+	 they read beyond the end of the string */
+__attribute__((no_sanitize_address))
+static const char *fsa_skip(const char *s, const char *stop)
+{
+#ifdef FSA_VLEN
+	uintptr_t misalign=(uintptr_t) s & (FSA_VLEN - 1);
+	const char *p=(const char *) ((uintptr_t) s - misalign);
+	uint32_t mask=fsa_stopmask(p, stop) >> misalign;
+	if (mask)
+		return s + __builtin_ctz(mask);
+	for (;;) {
+		p+=FSA_VLEN;
+		mask=fsa_stopmask(p, stop);
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#else
+	return s + strcspn(s, stop);
+#endif
+}
+
+#define FSA_SHORTRUN 8
+#define FSA_INRUN(state, c) (nextstate[state][charclass[(unsigned char) (c)]] == (state) && \
+		action[state][charclass[(unsigned char) (c)]] == CHCOPY)
 
 s2argv_getvar_t s2argv_getvar=NULL;
 int (* execs_fork_security)(void *execs_fork_security_arg);
 void *execs_fork_security_arg;
+#ifndef EEXECS
+int execs_spawn_mode=EXECS_SPAWN_VFORK;
+#endif
+
+/* the value of a variable: the variable store first, then getvar
+	 (as defined by ctx, or by the globals if ctx is NULL) */
+static char *s2argv_lookup(const struct execs_ctx *ctx, const char *name)
+{
+	s2argv_getvar_t getvar=ctx ? ctx->getvar : s2argv_getvar;
+#ifndef EEXECS
+	struct execs_vars *vars=ctx ? ctx->vars : s2argv_vars;
+	if (vars) {
+		const char *value=execs_vars_get(vars, name);
+		if (value)
+			return (char *) value;
+	}
+#endif
+	return getvar ? getvar(name) : NULL;
+}
+
+#define TAG_ARG 0
+#define TAG_VAR 1
+#define TAG_PIPE 2 // the NULL at the end of a stage of a pipeline
+#define TAG_REDIR 3 // a redirection operator (the next element is its target)
+#define TAG_GLOB 4 // an argument including unquoted pattern chars (EXECS_GLOB)
+
+/* check the syntax of a redirection operator: [n]< [n]> [n]>> [n]<& [n]>&
+	 where n (if present) is 0, 1 or 2 */
+static int fsa_redirop(const char *op, size_t len)
+{
+	const char *end=op + len;
+	if (*op >= '0' && *op <= '9' && *op++ > '2')
+		return 0;
+	if (*op == '<')
+		op++;
+	else if (*op == '>') {
+		op++;
+		if (op < end && *op == '>') {
+			op++;
+			return op == end;
+		}
+	} else
+		return 0;
+	if (op < end && *op == '&')
+		op++;
+	return op == end;
+}
+
+/* the unquoted chars from s to end are all digits */
+static int fsa_isnumber(const char *s, const char *end)
+{
+	for (; s < end; s++) {
+		if (*s < '0' || *s > '9')
+			return 0;
+	}
+	return 1;
+}
 
-static int args_fsa(const char *args, char **argv, char *buf, int flags)
+/* glob: the pattern chars of an argument are unquoted (FSA_GLOB) or quoted
+	 (FSA_NOGLOB, the argument is never expanded). In quoted text backslashes
+	 count as pattern chars, too */
+#define FSA_GLOB 1
+#define FSA_NOGLOB 2
+#define FSA_QUOTED(state) ((state) == SGLQ || (state) == DBLQ || (state) == ESCAPE || (state) == DBLESC)
+static int fsa_glob(const char *s, size_t len, int state)
+{
+	int quoted=FSA_QUOTED(state);
+	for (; len > 0; s++, len--) {
+		if (*s == '*' || *s == '?' || *s == '[' || (quoted && *s == '\\'))
+			return quoted ? FSA_NOGLOB : FSA_GLOB;
+	}
+	return 0;
+}
+
+/* when tags is not NULL, variables are not expanded: the name of the
+	 variable is stored in argv and the corresponding element of tags is TAG_VAR.
+	 If flags includes EXECS_GLOB, the elements of argv which need pathname
+	 expansion are tagged TAG_GLOB */
+static int args_fsa(const char *args, char **argv, char *buf, char *tags, int flags,
+		const struct execs_ctx *ctx)
 {
 	int state=SPACE;
 	int argc=0;
+	int cmdargc=0; // number of args of the current command (but redirections)
+	int inpipe=0; // the current command is a stage of a pipeline
+	int cmdredir=0; // the current command has redirections
+	int redirtarget=0; // the next arg is the target of a redirection
+	const char *argstart=NULL;
 	char *thisarg=NULL;
+	int glob=(tags != NULL && (flags & EXECS_GLOB));
+	int globarg=0;
 	for (;state != END;args++) {
-		int this;
-		switch (*args) {
-			case 0:
-				this=END;
-				break;
-			case ' ':
-			case '\t':
-			case '\n':
-				this=SPACE;
-				break;
-			case '\'':
-				this=SGLQ;
-				break;
-			case '"':
-				this=DBLQ;
-				break;
-			case '\\':
-				this=ESCAPE;
-				break;
-			case ';':
-				this=SEMIC;
-				break;
-			case '$':
-				this=VAR;
-				break;
-			default:
-				this=CHAR;
+		int this=FSA_CLASS(*args, flags);
+		int next=nextstate[state][this];
+		int act=action[state][this];
+		/* a single digit followed by < or > is part of the redirection operator.
+			 A shell would read a longer number as a descriptor (e.g. 12>file):
+			 it is an error */
+		if (state == CHAR && this == REDIR && fsa_isnumber(argstart, args)) {
+			if (args - argstart > 1)
+				return errno = EINVAL, -1;
+			act=CHCOPY;
 		}
 		if (argv) {
-			if (action[state][this] & NEWARG)
-				thisarg=buf;
-			if (action[state][this] & CHCOPY)
-				*buf++=*args;
-			if (action[state][this] & ENDARG) {
+			if (act & ENDARG) {
 				*buf++=0;
 				*argv++=thisarg;
+				if (tags) *tags++=(state == REDIR) ? TAG_REDIR :
+					(globarg == FSA_GLOB) ? TAG_GLOB : TAG_ARG;
 			}
-			if (action[state][this] & ENDVAR) {
+			if (act & ENDVAR) {
 				*buf++=0;
-				if (s2argv_getvar) {
-					*argv=s2argv_getvar(thisarg);
-					if (*argv == NULL)
-						*argv="";
-				} else
+				if (tags) {
+					*argv=thisarg;
+					*tags++=TAG_VAR;
+				} else if ((*argv=s2argv_lookup(ctx, thisarg)) == NULL)
 					*argv="";
 				argv++;
 			}
-			if (action[state][this] & ENDCMD)
+			if (act & NEWARG) {
+				thisarg=buf;
+				globarg=0;
+			}
+			if (act & CHCOPY) {
+				if (glob)
+					globarg|=fsa_glob(args, 1, state);
+				*buf++=*args;
+			}
+			if (act & ENDCMD) {
 				*argv++=0;
+				if (tags) *tags++=(next == PIPE) ? TAG_PIPE : TAG_ARG;
+			}
 		}
-		if (action[state][this] & (ENDARG|ENDVAR))
+		if (act & (ENDARG|ENDVAR)) {
 			argc++;
-		if (action[state][this] & ENDCMD)
+			if (state == REDIR) {
+				if (redirtarget || !fsa_redirop(argstart, args - argstart))
+					return errno = EINVAL, -1;
+				redirtarget=1;
+				cmdredir=1;
+			} else if (redirtarget)
+				redirtarget=0;
+			else
+				cmdargc++;
+		}
+		if (act & ENDCMD) {
+			/* empty commands are not allowed in pipelines or with redirections,
+				 each redirection needs its target */
+			if (((next == PIPE || inpipe || cmdredir) && cmdargc == 0) || redirtarget)
+				return errno = EINVAL, -1;
+			inpipe=(next == PIPE);
+			cmdargc=0;
+			cmdredir=0;
 			argc++;
+		}
+		if (act & NEWARG)
+			argstart=args;
 		//printf("%c %s+%s=%s %x\n",*args,sn[state],sn[this],sn[nextstate[state][this]],action[state][this]);
 		//printf("%s %d->%d\n",args,state,nextstate[state][this]);
-		state=nextstate[state][this];
+		state=next;
 		switch (state) {
 			case VAR: if (flags & EXECS_NOVAR) return errno = EINVAL, -1;
 									break;
 			case SEMIC: if (flags & EXECS_NOSEQ) return errno = EINVAL, -1;
 										break;
+			case PIPE: if (flags & EXECS_NOPIPE) return errno = EINVAL, -1;
+									 break;
+			case REDIR: if (flags & EXECS_NOREDIR) return errno = EINVAL, -1;
+										break;
+		}
+		/* fast path: copy the run of chars which do not change the state */
+		if (fsa_stopset[state]) {
+			const char *end;
+			size_t len;
+			/* the first chars are scanned one by one: many runs are short */
+			for (end=args + 1; end < args + 1 + FSA_SHORTRUN && FSA_INRUN(state, *end); end++)
+				;
+			if (end == args + 1 + FSA_SHORTRUN)
+				end=fsa_skip(end, fsa_stopset[state]);
+			len=end - (args + 1);
+			if (argv) {
+				if (glob)
+					globarg|=fsa_glob(args + 1, len, state);
+				memmove(buf, args + 1, len);
+				buf+=len;
+			}
+			args+=len;
 		}
 	}
-	if (argv)
+	if (argv) {
 		*argv=0;
+		if (tags) *tags=TAG_ARG;
+	}
 	return argc;
 }
 
 #ifndef EEXECS
 
+/* instrumentation */
+void (*execs_stats_hook)(const struct execs_stats *stats, void *arg);
+void *execs_stats_hook_arg;
+
+/* USDT tracepoints: the semaphores are set by the tracers (perf, bpftrace...)
+	 when the probes are in use */
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define EXECS_SEMAPHORE __attribute__((section(".probes")))
+#define EXECS_PROBE2(name, a1, a2) STAP_PROBE2(execs, name, a1, a2)
+#define EXECS_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(execs, name, a1, a2, a3, a4)
+#define EXECS_PROBE6(name, a1, a2, a3, a4, a5, a6) STAP_PROBE6(execs, name, a1, a2, a3, a4, a5, a6)
+#else
+#define EXECS_SEMAPHORE
+#define EXECS_PROBE2(name, a1, a2)
+#define EXECS_PROBE4(name, a1, a2, a3, a4)
+#define EXECS_PROBE6(name, a1, a2, a3, a4, a5, a6)
+#endif
+volatile unsigned short execs_parse_semaphore EXECS_SEMAPHORE;
+volatile unsigned short execs_spawn_semaphore EXECS_SEMAPHORE;
+volatile unsigned short execs_exit_semaphore EXECS_SEMAPHORE;
+
+long long _execs_stats_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define TIMEVAL_US(tv) ((tv).tv_sec * 1000000LL + (tv).tv_usec)
+void _execs_stats_emit(const struct execs_stats *stats)
+{
+	switch (stats->event) {
+		case EXECS_STATS_PARSE:
+			EXECS_PROBE2(parse, stats->args, stats->parse_ns);
+			break;
+		case EXECS_STATS_SPAWN:
+			EXECS_PROBE4(spawn, stats->pid, stats->argv[0], stats->spawn_ns, stats->exec_ns);
+			break;
+		case EXECS_STATS_EXIT:
+			EXECS_PROBE6(exit, stats->pid, stats->status, stats->wait_ns,
+					TIMEVAL_US(stats->rusage.ru_utime), TIMEVAL_US(stats->rusage.ru_stime),
+					stats->rusage.ru_maxrss);
+			break;
+	}
+	if (execs_stats_hook)
+		execs_stats_hook(stats, execs_stats_hook_arg);
+}
+
+static void s2argv_stats_parse(const char *args, long long start)
+{
+	struct execs_stats stats={EXECS_STATS_PARSE};
+	stats.args=args;
+	stats.parse_ns=_execs_stats_clock() - start;
+	_execs_stats_emit(&stats);
+}
+
+/* s2argv returns a single block of memory: the argv array followed by
+	 the strings. The values of variables get appended at the end. */
 char **s2argv(const char *args)
 {
-	int argc=args_fsa(args,NULL,NULL,0);
-	char buf[strlen(args)+1];
-	char **argv=calloc(argc+1,sizeof(char *));
+	int argc=args_fsa(args,NULL,NULL,NULL,FSA_LITERAL,NULL);
+	if (argc < 0)
+		return NULL;
+	size_t len=strlen(args)+1;
+	size_t argvlen=(argc+1) * sizeof(char *);
+	char tags[argc+1];
+	char **argv=malloc(argvlen + len);
 	if (argv) {
+		size_t extra=0;
 		int i;
-		args_fsa(args,argv,buf,0);
-		for (i=0; i<argc+1; i++)
-			argv[i]=argv[i]?strdup(argv[i]):0;
-		/* for (i=0; i<argc+1; i++)
-			printf("%d %s\n",i,argv[i]); */
+		args_fsa(args,argv,(char *) (argv + argc + 1),tags,FSA_LITERAL,NULL);
+		for (i=0; i<argc; i++) {
+			if (tags[i] == TAG_VAR) {
+				argv[i]=s2argv_lookup(NULL, argv[i]);
+				if (argv[i] == NULL)
+					argv[i]="";
+				extra+=strlen(argv[i]) + 1;
+			}
+		}
+		if (extra > 0) {
+			char **newargv=malloc(argvlen + len + extra);
+			char *value;
+			if (newargv == NULL) {
+				free(argv);
+				return NULL;
+			}
+			memcpy(newargv + argc + 1, argv + argc + 1, len);
+			value=((char *) newargv) + argvlen + len;
+			for (i=0; i<argc+1; i++) {
+				if (argv[i] == NULL)
+					newargv[i]=NULL;
+				else if (tags[i] == TAG_VAR) {
+					newargv[i]=value;
+					value=stpcpy(value, argv[i]) + 1;
+				} else
+					newargv[i]=((char *) newargv) + (argv[i] - (char *) argv);
+			}
+			free(argv);
+			argv=newargv;
+		}
 	}
 	return argv;
 }
 
 void s2argv_free(char **argv)
 {
-	char **scan;
-	for (scan=argv; *scan != (char *)0; scan++) {
-		for (; *scan != (char *)0; scan++)
-			free(*scan);
-	}
 	free(argv);
 }
 
@@ -191,16 +514,68 @@ size_t s2argc(char **argv) {
 	return argc;
 }
 
+struct s2argv_index *s2argv_indexed(const char *args)
+{
+	char **argv=s2argv(args);
+	struct s2argv_index *idx;
+	size_t ncmds=0;
+	size_t i;
+	if (argv == NULL)
+		return NULL;
+	for (i=0; argv[i]; i++, ncmds++)
+		for(; argv[i]; i++)
+			;
+	/* one block: the header and the offsets */
+	if ((idx=malloc(sizeof(*idx) + (ncmds + 1) * sizeof(size_t))) == NULL) {
+		s2argv_free(argv);
+		return NULL;
+	}
+	idx->ncmds=ncmds;
+	idx->start=(size_t *) (idx + 1);
+	idx->argv=argv;
+	for (i=0, ncmds=0; argv[i]; i++) {
+		idx->start[ncmds++]=i;
+		for(; argv[i]; i++)
+			;
+	}
+	idx->start[ncmds]=i;
+	return idx;
+}
+
+void s2argv_index_free(struct s2argv_index *idx)
+{
+	if (idx) {
+		s2argv_free(idx->argv);
+		free(idx);
+	}
+}
+
+char **s2argv_index_cmd(const struct s2argv_index *idx, size_t k)
+{
+	return (k < idx->ncmds) ? idx->argv + idx->start[k] : NULL;
+}
+
+size_t s2argv_index_argc(const struct s2argv_index *idx, size_t k)
+{
+	/* the next command (or the final NULL) follows the NULL terminating this one */
+	return (k < idx->ncmds) ? idx->start[k + 1] - idx->start[k] - 1 : 0;
+}
+
+/* f gets one argv at a time: pipelines and redirections are not supported
+	 (see s2multipipe), |, < and > are ordinary chars */
 int s2multiargv(const char *args,
 		int (*f)(char **argv, void *opaque), void *opaque, int flags)
 {
-	int argc=args_fsa(args,NULL,NULL,flags);
+	long long start=EXECS_STATS_ENABLED(parse) ? _execs_stats_clock() : 0;
+	int argc=args_fsa(args,NULL,NULL,NULL,flags | FSA_LITERAL,NULL);
 	if (argc < 0)
 		return -1;
 	char *argv[argc+1];
 	char buf[strlen(args)+1];
 	char **thisargv=argv;
-	args_fsa(args,argv,buf,0);
+	args_fsa(args,argv,buf,NULL,FSA_LITERAL,NULL);
+	if (start)
+		s2argv_stats_parse(args, start);
 	int rv=0;
 	while (*thisargv && rv==0) {
 		rv=f(thisargv, opaque);
@@ -209,16 +584,455 @@ int s2multiargv(const char *args,
 	}
 	return rv;
 }
-#endif
 
-int _execs_common(const char *path, const char *args, char *const envp[], char *buf, int flags)
+/* streaming multi argv: the input is split in commands at the semicolons
+	 (the FSA state is kept across the chunks of input), each command is parsed
+	 in place in a working buffer which is reused for the following commands */
+#define S2ARGV_STREAM_CHUNK (64 * 1024)
+/* default limit for the length of a command, if ARG_MAX is not available */
+#define S2ARGV_STREAM_MAXCMD (2 * 1024 * 1024)
+
+struct s2argv_stream {
+	ssize_t (*read)(void *src, char *buf, size_t len);
+	void *src;
+	char *data; // the current command (at the beginning) and the input read ahead
+	size_t size;
+	size_t len;
+	char **argv;
+	size_t argvsize;
+};
+
+/* scan len chars from *state: return the length of the command up to the
+	 first semicolon (included), -1 if the command continues, -2 if
+	 the input contains a NUL char */
+static ssize_t fsa_cmdend(int *state, const char *s, size_t len)
 {
-	int argc=args_fsa(args,NULL,NULL,flags);
-	char *argv[argc+1];
-	char tmpbuf[(buf == NULL) ? strlen(args) + 1 : 0];
-	if (buf == NULL) buf = tmpbuf;
-	if (args_fsa(args,argv,buf,flags) < 0)
+	size_t i;
+	for (i=0; i<len; i++) {
+		int this=FSA_CLASS(s[i], FSA_LITERAL);
+		if (this == END)
+			return -2;
+		*state=nextstate[*state][this];
+		if (*state == SEMIC)
+			return i + 1;
+	}
+	return -1;
+}
+
+static int s2argv_stream_cmd(struct s2argv_stream *st, char *cmd,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags)
+{
+	int argc=args_fsa(cmd,NULL,NULL,NULL,flags | FSA_LITERAL,NULL);
+	if (argc < 0)
 		return -1;
+	if (argc + 1 > st->argvsize) {
+		char **newargv=realloc(st->argv, (argc + 1) * sizeof(char *));
+		if (newargv == NULL)
+			return -1;
+		st->argv=newargv;
+		st->argvsize=argc + 1;
+	}
+	args_fsa(cmd,st->argv,cmd,NULL,FSA_LITERAL,NULL);
+	/* empty commands (e.g. a newline after the last semicolon) are skipped */
+	return (st->argv[0] == NULL) ? 0 : f(st->argv, opaque);
+}
+
+static int s2multiargv_stream(struct s2argv_stream *st,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags)
+{
+	long argmax=sysconf(_SC_ARG_MAX);
+	size_t maxcmd=(argmax > 0) ? argmax : S2ARGV_STREAM_MAXCMD;
+	/* the pending command starts at data + start: commands already parsed
+		 are discarded only before reading more data */
+	size_t start=0;
+	size_t scanned=0;
+	int state=SPACE;
+	int eof=0;
+	int rv=0;
+	while (rv == 0) {
+		ssize_t n;
+		if (scanned == st->len) {
+			if (eof)
+				break;
+			if (start > 0) {
+				st->len-=start;
+				memmove(st->data, st->data + start, st->len);
+				scanned=st->len;
+				start=0;
+			}
+			if (st->len > maxcmd) {
+				errno=E2BIG;
+				rv=-1;
+				break;
+			}
+			/* one more byte for the NUL at the end of the last command */
+			if (st->size - st->len < S2ARGV_STREAM_CHUNK + 1) {
+				size_t newsize=st->len + S2ARGV_STREAM_CHUNK + 1;
+				char *newdata=realloc(st->data, newsize);
+				if (newdata == NULL) {
+					rv=-1;
+					break;
+				}
+				st->data=newdata;
+				st->size=newsize;
+			}
+			while ((n=st->read(st->src, st->data + st->len, S2ARGV_STREAM_CHUNK)) < 0 &&
+					errno == EINTR)
+				;
+			if (n < 0) {
+				rv=-1;
+				break;
+			}
+			eof=(n == 0);
+			st->len+=n;
+			continue;
+		}
+		n=fsa_cmdend(&state, st->data + scanned, st->len - scanned);
+		if (n == -2 || (n > 0 && (flags & EXECS_NOSEQ))) {
+			errno=EINVAL;
+			rv=-1;
+		} else if (n == -1)
+			scanned=st->len;
+		else {
+			size_t cmdend=scanned + n;
+			st->data[cmdend - 1]=0;
+			rv=s2argv_stream_cmd(st, st->data + start, f, opaque, flags);
+			start=scanned=cmdend;
+			state=SPACE;
+		}
+	}
+	if (rv == 0 && st->len > start) {
+		st->data[st->len]=0;
+		rv=s2argv_stream_cmd(st, st->data + start, f, opaque, flags);
+	}
+	free(st->data);
+	free(st->argv);
+	return rv;
+}
+
+static ssize_t s2argv_read_fd(void *src, char *buf, size_t len)
+{
+	return read(*(int *) src, buf, len);
+}
+
+static ssize_t s2argv_read_file(void *src, char *buf, size_t len)
+{
+	size_t n=fread(buf, 1, len, src);
+	return (n == 0 && ferror((FILE *) src)) ? -1 : n;
+}
+
+/* the pages of a mapped file are unmapped while the parsing proceeds */
+#define S2ARGV_STREAM_UNMAP (1024 * 1024)
+
+struct s2argv_mem {
+	const char *data;
+	size_t len;
+	char *map; // NULL if data is not a mapped file
+	size_t maplen;
+};
+
+static ssize_t s2argv_read_mem(void *src, char *buf, size_t len)
+{
+	struct s2argv_mem *m=src;
+	if (len > m->len)
+		len=m->len;
+	memcpy(buf, m->data, len);
+	m->data+=len;
+	m->len-=len;
+	if (m->map && m->data - m->map >= S2ARGV_STREAM_UNMAP) {
+		size_t done=(m->data - m->map) & ~(S2ARGV_STREAM_UNMAP - 1);
+		munmap(m->map, done);
+		m->map+=done;
+		m->maplen-=done;
+	}
+	return len;
+}
+
+int s2multiargv_mem(const void *data, size_t len,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags)
+{
+	struct s2argv_mem m={data, len, NULL, 0};
+	struct s2argv_stream st={s2argv_read_mem, &m};
+	return s2multiargv_stream(&st, f, opaque, flags);
+}
+
+int s2multiargv_fd(int fd,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags)
+{
+	struct s2argv_stream st={s2argv_read_fd, &fd};
+	struct stat sbuf;
+	/* regular files are mapped: the data is read from the page cache */
+	if (fstat(fd, &sbuf) == 0 && S_ISREG(sbuf.st_mode) && sbuf.st_size > 0) {
+		off_t pos=lseek(fd, 0, SEEK_CUR);
+		if (pos >= 0 && pos < sbuf.st_size) {
+			off_t mappos=pos & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+			struct s2argv_mem m={NULL, sbuf.st_size - pos, NULL, sbuf.st_size - mappos};
+			m.map=mmap(NULL, m.maplen, PROT_READ, MAP_PRIVATE, fd, mappos);
+			if (m.map != MAP_FAILED) {
+				int rv;
+				madvise(m.map, m.maplen, MADV_SEQUENTIAL);
+				m.data=m.map + (pos - mappos);
+				st.read=s2argv_read_mem;
+				st.src=&m;
+				rv=s2multiargv_stream(&st, f, opaque, flags);
+				munmap(m.map, m.maplen);
+				/* the file offset is moved past the data used, as read(2) would */
+				lseek(fd, sbuf.st_size - m.len, SEEK_SET);
+				return rv;
+			}
+		}
+	}
+	return s2multiargv_stream(&st, f, opaque, flags);
+}
+
+int s2multiargv_file(FILE *stream,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags)
+{
+	struct s2argv_stream st={s2argv_read_file, stream};
+	return s2multiargv_stream(&st, f, opaque, flags);
+}
+
+/* copy the argv of a template (targv, tags) in argv expanding the variables */
+static void s2argv_instantiate(const struct execs_ctx *ctx, int argc, char *const *targv,
+		const char *tags, char **argv)
+{
+	int i;
+	for (i=0; i<argc+1; i++) {
+		if (tags[i] == TAG_VAR) {
+			argv[i]=s2argv_lookup(ctx, targv[i]);
+			if (argv[i] == NULL)
+				argv[i]="";
+		} else
+			argv[i]=targv[i];
+	}
+}
+
+/* call f for each pipeline of the multi argv (argv, tags).
+	 The argv of each command is copied in rargv, followed by its redirections
+	 (operator and target pairs) and by a further NULL.
+	 stages must have room for the argv of all the stages, rargv for
+	 2 * (argc + 1) elements */
+static int s2multipipe_argv(char **argv, const char *tags, char **rargv, char **stages[],
+		int (*f)(char **argv[], void *opaque), void *opaque)
+{
+	int i=0;
+	int rv=0;
+	while (argv[i] && rv==0) {
+		int n=0;
+		int j=0;
+		do {
+			int k;
+			stages[n++]=rargv + j;
+			for (k=i; argv[k]; k++) {
+				if (tags[k] == TAG_REDIR)
+					k++;
+				else
+					rargv[j++]=argv[k];
+			}
+			rargv[j++]=NULL;
+			for (k=i; argv[k]; k++) {
+				if (tags[k] == TAG_REDIR) {
+					rargv[j++]=argv[k++];
+					rargv[j++]=argv[k];
+				}
+			}
+			rargv[j++]=NULL;
+			i=k;
+		} while (tags[i++] == TAG_PIPE);
+		stages[n]=NULL;
+		rv=f(stages, opaque);
+	}
+	return rv;
+}
+
+/* pathname expansion of the arguments tagged TAG_GLOB (redirection targets
+	 are not expanded). Patterns matching no pathname are left unchanged */
+static int s2multipipe_glob(char **argv, const char *tags, int argc,
+		int (*f)(char **argv[], void *opaque), void *opaque)
+{
+	char **matches[argc+1];
+	size_t gargc=0;
+	void *mem=NULL;
+	int rv=-1;
+	int i;
+	for (i=0; i<argc; i++) {
+		matches[i]=NULL;
+		if (tags[i] == TAG_GLOB && (i == 0 || tags[i-1] != TAG_REDIR) &&
+				(matches[i]=_execs_glob(argv[i])) == NULL && errno == ENOMEM)
+			goto err;
+		if (matches[i]) {
+			char **match;
+			for (match=matches[i]; *match; match++)
+				gargc++;
+		} else
+			gargc++;
+	}
+	/* argv and tags of the expanded command, and the arrays of s2multipipe_argv */
+	if ((mem=malloc((gargc+1) * (4 * sizeof(char *) + 1))) != NULL) {
+		char **gargv=mem;
+		char **rargv=gargv + gargc + 1;
+		char ***stages=(char ***) (rargv + 2 * (gargc+1));
+		char *gtags=(char *) (stages + gargc + 1);
+		size_t j=0;
+		for (i=0; i<argc; i++) {
+			char **match;
+			if (matches[i] == NULL) {
+				gtags[j]=tags[i];
+				gargv[j++]=argv[i];
+			} else for (match=matches[i]; *match; match++) {
+				gtags[j]=TAG_ARG;
+				gargv[j++]=*match;
+			}
+		}
+		gtags[j]=tags[argc];
+		gargv[j]=NULL;
+		rv=s2multipipe_argv(gargv, gtags, rargv, stages, f, opaque);
+	}
+err:
+	while (--i >= 0)
+		free(matches[i]);
+	free(mem);
+	return rv;
+}
+
+int s2multipipe(const char *args,
+		int (*f)(char **argv[], void *opaque), void *opaque, int flags)
+{
+	return _s2multipipe_ctx(NULL, args, f, opaque, flags);
+}
+
+int _s2multipipe_ctx(const struct execs_ctx *ctx, const char *args,
+		int (*f)(char **argv[], void *opaque), void *opaque, int flags)
+{
+	long long start=EXECS_STATS_ENABLED(parse) ? _execs_stats_clock() : 0;
+	int argc=args_fsa(args,NULL,NULL,NULL,flags,NULL);
+	if (argc < 0)
+		return -1;
+	char *argv[argc+1];
+	char tags[argc+1];
+	char *rargv[2 * (argc+1)];
+	char **stages[argc+1];
+	/* a redirection operator can be adjacent to its arguments (e.g. "a>b"):
+		 the strings may need a NUL for each item */
+	char buf[strlen(args)+argc+1];
+	args_fsa(args,argv,buf,tags,flags,NULL);
+	s2argv_instantiate(ctx, argc, argv, tags, argv);
+	if (start)
+		s2argv_stats_parse(args, start);
+	if (flags & EXECS_GLOB)
+		return s2multipipe_glob(argv, tags, argc, f, opaque);
+	return s2multipipe_argv(argv, tags, rargv, stages, f, opaque);
+}
+
+/* a parsed command: argv template, tags and the strings in one block */
+struct s2argv_template {
+	int argc;
+	int glob; // the template includes patterns (EXECS_GLOB)
+	char **argv;
+	char *tags;
+};
+
+/* the same args can have two meanings: s2multipipe_compiled applies pipelines
+	 and redirections, s2multiargv_compiled and execs_run_compiled take |, <, >
+	 and & literally, as s2multiargv and execs do. Args without those chars is
+	 parsed once (pipe == literal) */
+struct s2argv_compiled {
+	struct s2argv_template *pipe; // NULL if args is not a valid pipeline (e.g. "ls |")
+	struct s2argv_template *literal;
+};
+
+static struct s2argv_template *s2argv_template_new(const char *args, int flags)
+{
+	int argc=args_fsa(args,NULL,NULL,NULL,flags,NULL);
+	size_t len=strlen(args)+argc+1; // see s2multipipe
+	struct s2argv_template *t;
+	if (argc < 0)
+		return NULL;
+	t=malloc(sizeof(*t) + (argc+1) * (sizeof(char *) + 1) + len);
+	if (t) {
+		t->argc=argc;
+		t->argv=(char **) (t + 1);
+		t->tags=(char *) (t->argv + argc + 1);
+		args_fsa(args,t->argv,t->tags + argc + 1,t->tags,flags,NULL);
+		t->glob=memchr(t->tags, TAG_GLOB, argc + 1) != NULL;
+	}
+	return t;
+}
+
+struct s2argv_compiled *s2argv_compile(const char *args, int flags)
+{
+	struct s2argv_compiled *t=malloc(sizeof(*t));
+	if (t == NULL)
+		return NULL;
+	t->pipe=NULL;
+	if ((t->literal=s2argv_template_new(args, flags | FSA_LITERAL)) == NULL)
+		goto err;
+	if (strpbrk(args, "|<>&") == NULL)
+		t->pipe=t->literal;
+	else if ((t->pipe=s2argv_template_new(args, flags)) == NULL && errno != EINVAL)
+		goto err;
+	return t;
+err:
+	s2argv_compiled_free(t);
+	return NULL;
+}
+
+void s2argv_compiled_free(struct s2argv_compiled *t)
+{
+	int errno_save=errno;
+	if (t == NULL)
+		return;
+	if (t->pipe != t->literal)
+		free(t->pipe);
+	free(t->literal);
+	free(t);
+	errno=errno_save;
+}
+
+int s2multiargv_compiled(const struct s2argv_compiled *t,
+		int (*f)(char **argv, void *opaque), void *opaque)
+{
+	const struct s2argv_template *lt=t->literal;
+	char *argv[lt->argc+1];
+	char **thisargv=argv;
+	int rv=0;
+	s2argv_instantiate(NULL, lt->argc, lt->argv, lt->tags, argv);
+	while (*thisargv && rv==0) {
+		rv=f(thisargv, opaque);
+		while (*thisargv) thisargv++;
+		thisargv++;
+	}
+	return rv;
+}
+
+int s2multipipe_compiled(const struct s2argv_compiled *t,
+		int (*f)(char **argv[], void *opaque), void *opaque)
+{
+	const struct s2argv_template *pt=t->pipe;
+	if (pt == NULL)
+		return errno = EINVAL, -1;
+	char *argv[pt->argc+1];
+	char *rargv[2 * (pt->argc+1)];
+	char **stages[pt->argc+1];
+	s2argv_instantiate(NULL, pt->argc, pt->argv, pt->tags, argv);
+	if (pt->glob)
+		return s2multipipe_glob(argv, pt->tags, pt->argc, f, opaque);
+	return s2multipipe_argv(argv, pt->tags, rargv, stages, f, opaque);
+}
+
+int execs_run_compiled(const char *path, const struct s2argv_compiled *t, char *const envp[])
+{
+	const struct s2argv_template *lt=t->literal;
+	char *argv[lt->argc+1];
+	s2argv_instantiate(NULL, lt->argc, lt->argv, lt->tags, argv);
+	return _execs_argv(path, argv, envp, -1);
+}
+#endif
+
+static int execs_argv(const char *path, char *const argv[], char *const envp[], int pathfd)
+{
+	if (argv[0] == NULL)
+		return errno = EINVAL, -1;
 	if (path) {
 		if (*path)
 			return execve(path, argv, envp);
@@ -228,6 +1042,149 @@ int _execs_common(const char *path, const char *args, char *const envp[], char *
 			else
 				return errno = EACCES, -1;
 		}
-	} else
+	} else {
+#ifndef EEXECS
+		if (pathfd >= 0)
+			fexecve(pathfd, argv, envp);
+#endif
 		return execvpe(argv[0], argv, envp);
+	}
+}
+
+static int execs_common(const struct execs_ctx *ctx, const char *path, const char *args,
+		char *const envp[], char *buf, int flags)
+{
+	/* a single exec cannot run pipelines or redirections */
+	flags |= FSA_LITERAL;
+	int argc=args_fsa(args,NULL,NULL,NULL,flags,NULL);
+	if (argc < 0)
+		return -1;
+	char *argv[argc+1];
+	char tmpbuf[(buf == NULL) ? strlen(args) + 1 : 0];
+	if (buf == NULL) buf = tmpbuf;
+	if (args_fsa(args,argv,buf,NULL,flags,ctx) < 0)
+		return -1;
+	/* the path cache is not used here: this can be a child sharing the memory
+		 of its parent (e.g. esystem), the cache and its descriptors belong to the
+		 parent. system_*, popen_* and coproc* look up the cache before spawning */
+	return execs_argv(path, argv, envp, -1);
 }
+
+int _execs_common(const char *path, const char *args, char *const envp[], char *buf, int flags)
+{
+	return execs_common(NULL, path, args, envp, buf, flags);
+}
+
+#ifndef EEXECS
+int _execs_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *args, char *buf, int flags)
+{
+	if (ctx == NULL)
+		return execs_common(NULL, path, args, environ, buf, flags);
+	return execs_common(ctx, path, args, ctx->envp ? ctx->envp : environ, buf,
+			flags | ctx->flags);
+}
+
+void execs_ctx_init(struct execs_ctx *ctx)
+{
+	ctx->getvar=s2argv_getvar;
+	ctx->vars=s2argv_vars;
+	ctx->fork_security=execs_fork_security;
+	ctx->fork_security_arg=execs_fork_security_arg;
+	ctx->spawn_mode=execs_spawn_mode;
+	ctx->flags=0;
+	ctx->envp=NULL;
+}
+
+int _execs_argv(const char *path, char *const argv[], char *const envp[], int pathfd)
+{
+	return execs_argv(path, argv, envp, pathfd);
+}
+
+/* default stack of vfork children (it is just reserved: untouched pages
+	 are not allocated) */
+#define EXECS_SPAWN_STACKSIZE (256 * 1024)
+
+struct execs_spawn_arg {
+	int (*child)(void *arg);
+	void *arg;
+	sigset_t *oldmask;
+	int (*fork_security)(void *fork_security_arg);
+	void *fork_security_arg;
+};
+
+static int execs_spawn_vfork_child(void *arg) {
+	struct execs_spawn_arg *sa=arg;
+	int sig;
+	/* the handlers of the parent must not run in a child sharing its memory */
+	for (sig=1; sig<NSIG; sig++) {
+		struct sigaction sact;
+		if (sigaction(sig, NULL, &sact) == 0 &&
+				sact.sa_handler != SIG_IGN && sact.sa_handler != SIG_DFL) {
+			sact.sa_handler=SIG_DFL;
+			sact.sa_flags=0;
+			sigaction(sig, &sact, NULL);
+		}
+	}
+	sigprocmask(SIG_SETMASK, sa->oldmask, NULL);
+	if (__builtin_expect(sa->fork_security && sa->fork_security(sa->fork_security_arg) != 0, 0))
+		return 127;
+	return sa->child(sa->arg);
+}
+
+static pid_t execs_spawn_vfork(struct execs_spawn_arg *sa, size_t stacksize) {
+	size_t pagesize=sysconf(_SC_PAGESIZE);
+	size_t size=(EXECS_SPAWN_STACKSIZE + stacksize + pagesize - 1) & ~(pagesize - 1);
+	char *stack=mmap(NULL, size, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+	sigset_t allmask, oldmask;
+	pid_t pid;
+	int saved_errno;
+	if (stack == MAP_FAILED)
+		return -1;
+	/* signals are blocked: the child resets the handlers before unblocking them */
+	sigfillset(&allmask);
+	sigprocmask(SIG_BLOCK, &allmask, &oldmask);
+	sa->oldmask=&oldmask;
+	pid=clone(execs_spawn_vfork_child, stack + size, CLONE_VM|CLONE_VFORK|SIGCHLD, sa);
+	saved_errno=errno;
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+	munmap(stack, size);
+	errno=saved_errno;
+	return pid;
+}
+
+pid_t _execs_spawn(int (*child)(void *arg), void *arg, size_t stacksize)
+{
+	return _execs_spawn_ctx(NULL, child, arg, stacksize);
+}
+
+pid_t _execs_spawn_ctx(const struct execs_ctx *ctx,
+		int (*child)(void *arg), void *arg, size_t stacksize)
+{
+	struct execs_spawn_arg sa={child, arg, NULL};
+	int mode;
+	pid_t pid;
+	if (ctx) {
+		sa.fork_security=ctx->fork_security;
+		sa.fork_security_arg=ctx->fork_security_arg;
+		mode=ctx->spawn_mode;
+	} else {
+		sa.fork_security=execs_fork_security;
+		sa.fork_security_arg=execs_fork_security_arg;
+		mode=execs_spawn_mode;
+	}
+	if ((mode & EXECS_SPAWN_MODEMASK) == EXECS_SPAWN_VFORK &&
+			(sa.fork_security == NULL || (mode & EXECS_SPAWN_HOOKSAFE))) {
+		if ((pid=execs_spawn_vfork(&sa, stacksize)) != -1 || errno != ENOMEM)
+			return pid;
+	}
+	/* EXECS_SPAWN_FORK, or fallback */
+	if ((pid=fork()) == 0) {
+		if (__builtin_expect(sa.fork_security && sa.fork_security(sa.fork_security_arg) != 0, 0))
+			_exit(127);
+		_exit(child(arg));
+	}
+	return pid;
+}
+#endif
@@ -24,9 +24,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 
 #define EXECS_SOVERSION 1
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern char **environ;
 
 /* This header file declares all the functions defined in
@@ -53,8 +58,22 @@ extern void *execs_fork_security_arg;
 	 require an extra copy of args on the stack */
 /* in all eexecs* functions, the string args is modified
 	 (no extra copies on the stack, args is parsed on itself): */
+/* restriction flags: EXECS_NOSEQ, EXECS_NOVAR, EXECS_NOPIPE and EXECS_NOREDIR
+	 make sequences (;), variables ($name), pipelines (|) and redirections
+	 (< > >> and n>&m) a syntax error (errno=EINVAL). execs* functions
+	 never support pipelines and redirections: for them (and for s2argv and
+	 s2multiargv) |, <, > and & are ordinary chars (e.g. "a|b" is an argument).
+	 Where redirections are supported, a number of two or more digits
+	 followed by < or > (e.g. "12>file") is a syntax error */
 #define EXECS_NOSEQ 0x1
 #define EXECS_NOVAR 0x2
+#define EXECS_NOPIPE 0x4
+#define EXECS_NOREDIR 0x8
+/* EXECS_GLOB enables the pathname expansion of the unquoted arguments
+	 including *, ? or [ (s2multipipe and the functions based on it).
+	 The values of variables and the targets of redirections are never expanded,
+	 patterns matching no pathname are left unchanged */
+#define EXECS_GLOB 0x10
 
 int _execs_common(const char *path, const char *args, char *const envp[], char *buf, int flags);
 
@@ -68,6 +87,8 @@ int _execs_common(const char *path, const char *args, char *const envp[], char *
 #define eexecsp(args) _execs_common(NULL,(args),environ,(args),EXECS_NOSEQ)
 #define eexecspe(args,env) _execs_common(NULL,(args),(env),(args),EXECS_NOSEQ)
 
+/* esystem must work with libeexecs, too: it uses fork(2), not the spawn
+	 engine of libexecs (system_execsp does) */
 static inline int system_eexecsp(const char *command) {
 	int status;
 	pid_t pid;
@@ -88,11 +109,82 @@ static inline int system_eexecsp(const char *command) {
 
 /******** library functions defined in libexecs only (not in libeexec) ********/
 
+/* spawn engine: how child processes get created by this library */
+/* EXECS_SPAWN_FORK: fork(2), the child is a full copy of the parent */
+/* EXECS_SPAWN_VFORK (default): clone(2) with CLONE_VM|CLONE_VFORK, the child
+	 shares the memory of the parent (which is suspended until the child
+	 either execs or exits), so the spawn cost does not depend on the size
+	 of the parent process */
+/* execs_fork_security usually needs a full child (e.g. it may change the
+	 memory of the process), so when it is defined the library falls back to
+	 fork unless EXECS_SPAWN_HOOKSAFE is set, too */
+#define EXECS_SPAWN_FORK 0
+#define EXECS_SPAWN_VFORK 1
+#define EXECS_SPAWN_MODEMASK 0xff
+#define EXECS_SPAWN_HOOKSAFE 0x100
+/* EXECS_SPAWN_NOSERVER: do not use the spawn server (see execs_server_start) */
+#define EXECS_SPAWN_NOSERVER 0x200
+extern int execs_spawn_mode;
+
+/* execution contexts: a context carries the settings that are otherwise
+	 taken from the globals (s2argv_getvar, s2argv_vars, execs_fork_security,
+	 execs_fork_security_arg, execs_spawn_mode and environ), plus restriction
+	 flags added to those of each call (e.g. EXECS_NOVAR).
+	 The *_ctx variants of _execs_common, _system_common, _popen_common and
+	 _coprocess_common use the context instead of the globals, so threads can
+	 run commands concurrently using different settings.
+	 Contexts are read only for the library: a context can be shared by
+	 several threads. ctx == NULL means the globals.
+	 execs_ctx_init initializes ctx with the current values of the globals.
+	 The spawn server runs the fork_security hook it inherited when it was
+	 started: it is used only if the hook of the context is the global one */
+struct execs_vars;
+struct execs_ctx {
+	char * (* getvar) (const char *name);
+	struct execs_vars *vars; // libexecs only
+	int (* fork_security)(void *fork_security_arg);
+	void *fork_security_arg;
+	int spawn_mode;
+	int flags;
+	char *const *envp; // NULL means environ
+};
+void execs_ctx_init(struct execs_ctx *ctx);
+
+/* run child(arg) in a new process created by the current spawn engine.
+	 The child process runs execs_fork_security (if defined), then child,
+	 which should exec a program: if it returns, its return value is the exit
+	 status. stacksize is the amount of stack needed by child (in addition
+	 to the default size) */
+pid_t _execs_spawn(int (*child)(void *arg), void *arg, size_t stacksize);
+pid_t _execs_spawn_ctx(const struct execs_ctx *ctx,
+		int (*child)(void *arg), void *arg, size_t stacksize);
+
+/* stack needed to parse a command string of len bytes (argv + buffer) */
+#define EXECS_SPAWN_STACK(len) (((len) + 3) * (sizeof(char *) + 1))
+
+/* the environment is ctx->envp */
+int _execs_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *args, char *buf, int flags);
+
+/* exec argv, path has the same meaning as in _execs_common.
+	 pathfd is -1 or a descriptor of argv[0] returned by _execs_path_lookup */
+int _execs_argv(const char *path, char *const argv[], char *const envp[], int pathfd);
+
 int _system_common(const char *path, const char *command, int redir[3], int flags);
+int _system_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *command, int redir[3], int flags);
 
 /* system_safe requires the absolute path of the command */
 /* system_execs executes the program whose path has been passed as its first arg. */
-#define system_safe(cmd)                  _system_common("",(cmd),NULL,EXECS_NOSEQ | EXECS_NOVAR)
+/* all the system_* functions but system_safe support pipelines (e.g. "ls | wc"):
+	 the commands of a pipeline run concurrently, connected by pipes, and
+	 the wait status is the one of the last command */
+/* system_*, popen_* and coproc* functions (but system_safe) support
+	 redirections of the standard descriptors: "<file", ">file", ">>file"
+	 and "n>&m" (n and m in 0..2, e.g. "2>&1"), also with an explicit
+	 descriptor number (e.g. "2>/dev/null"). Redirections are applied after
+	 the redir argument and the pipes of pipelines */
+#define system_safe(cmd)                  _system_common("",(cmd),NULL,EXECS_NOSEQ | EXECS_NOVAR | EXECS_NOPIPE | EXECS_NOREDIR)
 
 #define system_execs(path,cmd)            _system_common((path),(cmd),NULL,EXECS_NOSEQ)
 #define system_execsp(cmd)                _system_common(NULL,(cmd),NULL,EXECS_NOSEQ)
@@ -111,22 +203,226 @@ int _system_common(const char *path, const char *command, int redir[3], int flag
 #define system_execsqrp(cmd,redir)        _system_common(NULL,(cmd),(redir),0)
 #define system_execsqra(cmd,redir)        _system_common("",(cmd),(redir),0)
 
+/* parallel execution of sequences: the commands separated by semicolons
+	 run concurrently, at most maxjobs at a time (maxjobs <= 0 means the number
+	 of online processors). All the commands run, even if some of them fail.
+	 The wait status of the i-th command is stored in status[i] (for i < nstatus).
+	 The return value is 0 if all the commands succeeded, otherwise the wait
+	 status of the first failed command (in input order), -1 if there is not
+	 enough memory for maxjobs jobs. Pipelines are not supported */
+int _system_parallel(const char *path, const char *command, int redir[3], int flags,
+		int maxjobs, int status[], int nstatus);
+
+#define system_execsq_parallel(cmd,maxjobs,status,nstatus) \
+	_system_parallel(NULL,(cmd),NULL,0,(maxjobs),(status),(nstatus))
+#define system_execsqa_parallel(cmd,maxjobs,status,nstatus) \
+	_system_parallel("",(cmd),NULL,0,(maxjobs),(status),(nstatus))
+#define system_execsqrp_parallel(cmd,redir,maxjobs,status,nstatus) \
+	_system_parallel(NULL,(cmd),(redir),0,(maxjobs),(status),(nstatus))
+
+/* xargs: run command (parsed once) with further arguments appended,
+	 in batches as large as ARG_MAX permits (the size of the environment
+	 and of the command are taken into account), so that there are as few
+	 commands as possible. The arguments are the elements of the NULL
+	 terminated array args, or the items read from stream separated by delim
+	 (e.g. '\n' or '\0'). No command runs if there are no arguments.
+	 At most maxjobs batches run concurrently (maxjobs <= 0 means the number
+	 of online processors, 1 runs the batches sequentially).
+	 The command can include redirections, sequences and pipelines are not
+	 supported. The return value is 0 if all the batches succeeded, otherwise
+	 the wait status of the first failed batch. It returns -1 if an argument is
+	 too long (errno=E2BIG, the remaining arguments are not used), or in case
+	 of errors reading stream or allocating memory */
+int _system_xargs(const char *path, const char *command, char *const args[],
+		int redir[3], int flags, int maxjobs);
+int _system_xargs_stream(const char *path, const char *command, FILE *stream, int delim,
+		int redir[3], int flags, int maxjobs);
+
+#define system_execs_xargs(path,cmd,args,maxjobs) \
+	_system_xargs((path),(cmd),(args),NULL,0,(maxjobs))
+#define system_execsp_xargs(cmd,args,maxjobs) \
+	_system_xargs(NULL,(cmd),(args),NULL,0,(maxjobs))
+#define system_execsp_xargs_stream(cmd,stream,delim,maxjobs) \
+	_system_xargs_stream(NULL,(cmd),(stream),(delim),NULL,0,(maxjobs))
+
+/* deadlines: the commands still running after timeout milliseconds
+	 (negative: no limit) get SIGTERM, then SIGKILL 100ms later.
+	 Sequences (;) and pipelines run in their own process groups, the
+	 signals are sent to the whole group (so the commands cannot read from
+	 the terminal). The deadline applies to the whole sequence.
+	 The return value is the wait status, or -1 and errno=ETIMEDOUT if the
+	 commands have been killed (they have been waited for, anyway) */
+int _system_deadline(const char *path, const char *command, int redir[3], int flags,
+		int timeout);
+int _system_deadline_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, int redir[3], int flags, int timeout);
+
+#define system_execs_deadline(path,cmd,timeout)    _system_deadline((path),(cmd),NULL,EXECS_NOSEQ,(timeout))
+#define system_execsp_deadline(cmd,timeout)        _system_deadline(NULL,(cmd),NULL,EXECS_NOSEQ,(timeout))
+#define system_execsrp_deadline(cmd,redir,timeout) _system_deadline(NULL,(cmd),(redir),EXECS_NOSEQ,(timeout))
+#define system_nosh_deadline(cmd,timeout)          _system_deadline(NULL,(cmd),NULL,0,(timeout))
+#define system_execsqrp_deadline(cmd,redir,timeout) _system_deadline(NULL,(cmd),(redir),0,(timeout))
+
+/* $PATH cache: libexecs keeps the executable files found along $PATH open
+	 (O_PATH), so commands run by system_execsp, popen_execsp, coprocsp
+	 etc. do not need to search $PATH each time. The lookup takes place in the
+	 calling process before spawning: execsp* and esystem do not use the cache
+	 (they can run in a child sharing the memory of its parent).
+	 Entries are checked by stat(2) at each use, and all of them get flushed
+	 when the value of $PATH changes. execs_path_flush empties the cache (e.g.
+	 when a new executable file has been added to a directory of $PATH) */
+void execs_path_flush(void);
+
+/* return a new (O_PATH, O_CLOEXEC) file descriptor of the executable file
+	 named file as found along $PATH, or -1. If nowait is not zero, it
+	 returns -1 when the cache is busy */
+int _execs_path_lookup(const char *file, int nowait);
+
+/* spawn server: execs_server_start forks a helper process which creates
+	 all the processes requested by system_*, popen_* and coproc* on behalf of
+	 the calling process, so the cost of each spawn does not depend on the size
+	 (memory, threads) of the caller. It should be called early, when the
+	 process is still small. The new processes are children of the caller as
+	 usual (the server creates them by clone(2) with CLONE_PARENT), their
+	 standard descriptors, working directory and environment are those
+	 requested by the caller, other attributes (e.g. signal mask, rlimits,
+	 execs_fork_security) are inherited from the state of the caller when
+	 execs_server_start was called.
+	 If the server is not running the library creates processes by itself.
+	 The server belongs to the process which started it: a child created by
+	 fork(2) does not use it (it can start its own server). The server
+	 terminates at execs_server_stop, or when the process which started it
+	 calls execve(2) or terminates (the termination of the thread which
+	 called execs_server_start does not matter). */
+int execs_server_start(void);
+void execs_server_stop(void);
+
+/* create a child process by the spawn server (-1, errno=ENOTCONN if the
+	 server is not running). The child runs _execs_child_exec */
+pid_t _execs_server_spawn(const char *path, const char *file, char *const argv[],
+		char *const envp[], const int fds[3], int pathfd);
+
+/* fds[i] (if not negative) becomes the descriptor i (i=0,1,2), then exec argv,
+	 path as in _execs_common. If path is NULL, file (if not NULL) is searched
+	 along $PATH instead of argv[0] */
+int _execs_child_exec(const char *path, const char *file, char *const argv[],
+		char *const envp[], const int fds[3], int pathfd);
+
+/* instrumentation: when execs_stats_hook is defined, it gets called for
+	 each event of the library:
+	 EXECS_STATS_PARSE: a command string (args) has been parsed in parse_ns
+	 EXECS_STATS_SPAWN: a process (pid) has been created to run argv,
+		 spawn_ns is the time needed to create it, exec_ns the time from the
+		 beginning of the spawn to the exec (-1 if it is unknown, e.g. when
+		 the spawn server is running, or if exec failed)
+	 EXECS_STATS_EXIT: the library has reaped a process (pid): its wait status,
+		 resource usage (see wait4(2)) and the time spent waiting for it.
+		 (processes reaped by the caller, e.g. coprocesses or by
+		 execs_async_wait, are not reported).
+	 All times are in nanoseconds.
+	 The same data is available to perf, bpftrace etc. by the USDT tracepoints
+	 execs:parse, execs:spawn and execs:exit (when supported by the build).
+	 When the hook is not defined and no tracepoint is in use nothing gets
+	 measured */
+#define EXECS_STATS_PARSE 1
+#define EXECS_STATS_SPAWN 2
+#define EXECS_STATS_EXIT 3
+struct execs_stats {
+	int event;
+	pid_t pid;
+	const char *args;
+	char *const *argv;
+	long long parse_ns;
+	long long spawn_ns;
+	long long exec_ns;
+	long long wait_ns;
+	int status;
+	struct rusage rusage;
+};
+extern void (*execs_stats_hook)(const struct execs_stats *stats, void *arg);
+extern void *execs_stats_hook_arg;
+
+/* USDT semaphores */
+extern volatile unsigned short execs_parse_semaphore;
+extern volatile unsigned short execs_spawn_semaphore;
+extern volatile unsigned short execs_exit_semaphore;
+#define EXECS_STATS_ENABLED(event) (execs_stats_hook != NULL || execs_##event##_semaphore)
+
+/* clock for the instrumentation (nanoseconds) and event notification */
+long long _execs_stats_clock(void);
+void _execs_stats_emit(const struct execs_stats *stats);
+
+/* compiled commands (see s2argv_compile below) */
+struct s2argv_compiled;
+int _system_compiled(const char *path, const struct s2argv_compiled *t, int redir[3]);
+
+#define system_execs_compiled(path,t)     _system_compiled((path),(t),NULL)
+#define system_execsp_compiled(t)         _system_compiled(NULL,(t),NULL)
+#define system_execsa_compiled(t)         _system_compiled("",(t),NULL)
+#define system_execsrp_compiled(t,redir)  _system_compiled(NULL,(t),(redir))
+
 FILE *_popen_common(const char *path, const char *command, const char *type, int flags);
+FILE *_popen_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *command, const char *type, int flags);
 /* popen_execs/pclose_execs do not use $PATH to search the executable file*/
+/* popen and pclose functions can be used concurrently by several threads */
 int pclose_execs(FILE *stream);
+/* pclose_execs_deadline: as pclose_execs, but the commands still running
+	 after timeout milliseconds get killed as explained for _system_deadline
+	 (popen commands do not have their own process group: each command is
+	 signaled) */
+int pclose_execs_deadline(FILE *stream, int timeout);
 
 /* popen_nosh is an "almost" drop in replacement for popen(3),
 	 and pclose_nosh is its counterpart for pclose(3). */
-#define popen_nosh(cmd, type) _popen_common(NULL, (cmd), (type))
-#define pclose_nosh(stream) _popen_common(stream)
+/* popen functions support pipelines: the stream is connected to the
+	 standard input of the first command (type "w") or to the standard output
+	 of the last command (type "r"). pclose waits for all the commands */
+#define popen_nosh(cmd, type) _popen_common(NULL, (cmd), (type), 0)
+#define pclose_nosh(stream) pclose_execs(stream)
 
 #define popen_execs(path, cmd, type) _popen_common(path, (cmd), (type), EXECS_NOSEQ)
 #define popen_execsp(cmd, type) _popen_common(NULL, (cmd), (type), EXECS_NOSEQ)
 #define pclose_execsp(stream) pclose_execs(stream)
 
-/* run a command in coprocessing mode */
+/* output capture: run a command (pipelines and sequences are supported
+	 as in system_nosh, system_execs_capture and system_execsp_capture do not
+	 support sequences) and collect its standard output in cap->buf.
+	 The output is read from the pipe into the buffer, without stdio.
+	 The output is appended at cap->buf + cap->len, buf is NUL terminated and
+	 grows as needed (cap->size is its capacity): a struct execs_capture
+	 initialized to zero gets a new buffer, set cap->len=0 to reuse the buffer.
+	 cap->flags: EXECS_CAPTURE_STDERR captures the standard error, too.
+	 EXECS_CAPTURE_MMAP: the buffer is an anonymous memory mapping grown by
+	 mremap (suitable for large outputs, the data is never copied).
+	 The flag must not change while buf is allocated.
+	 The return value is the wait status (see system(3)), or -1 if the output
+	 could not be captured (errno is set, the commands get EPIPE) */
+#define EXECS_CAPTURE_STDERR 0x1
+#define EXECS_CAPTURE_MMAP 0x2
+struct execs_capture {
+	char *buf;
+	size_t len;
+	size_t size;
+	int flags;
+};
+int _system_capture(const char *path, const char *command,
+		struct execs_capture *cap, int flags);
+int _system_capture_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, struct execs_capture *cap, int flags);
+/* free cap->buf */
+void execs_capture_free(struct execs_capture *cap);
+
+#define system_execs_capture(path,cmd,cap)   _system_capture((path),(cmd),(cap),EXECS_NOSEQ)
+#define system_execsp_capture(cmd,cap)       _system_capture(NULL,(cmd),(cap),EXECS_NOSEQ)
+#define system_nosh_capture(cmd,cap)         _system_capture(NULL,(cmd),(cap),0)
+
+/* run a command in coprocessing mode (pipelines are not supported) */
 pid_t _coprocess_common(const char *path, const char *command,
 		char *const argv[], char *const envp[], int pipefd[2], int flags);
+/* the environment is ctx->envp */
+pid_t _coprocess_common_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, char *const argv[], int pipefd[2], int flags);
 
 #define coprocv(path, argv, pfd) _coprocess_common((path),NULL,(argv), environ, pfd, EXECS_NOSEQ)
 #define coprocve(path, argv, env, pfd) _coprocess_common((path),NULL,(argv), (env), pfd, EXECS_NOSEQ)
@@ -138,16 +434,92 @@ pid_t _coprocess_common(const char *path, const char *command,
 #define coprocsp(cmd, pfd) _coprocess_common(NULL,(cmd),NULL, environ, pfd, EXECS_NOSEQ)
 #define coprocspe(cmd, env, pfd) _coprocess_common(NULL,(cmd),NULL, (env), pfd, EXECS_NOSEQ)
 
+/* coprocess_pump streams data through a coprocess: pipefd is the pair
+	 returned by coproc*. The input is read from infd (if infd >= 0) or taken
+	 from inbuf/inlen (inbuf == NULL: no input). The output is written to outfd
+	 (if outfd >= 0) or collected in a NUL terminated malloc-ed buffer returned
+	 in *outbuf (outbuf == NULL: the output is discarded).
+	 Input and output are multiplexed by poll, so there are no deadlocks, pipes
+	 are enlarged by F_SETPIPE_SZ and fd-to-pipe transfers use splice(2).
+	 infd and outfd are used in blocking mode.
+	 pipefd[0] and pipefd[1] are closed, the caller must wait for the coprocess.
+	 It returns the number of bytes of output (and stores it in *outlen if not
+	 NULL) or -1 in case of error. */
+ssize_t coprocess_pump(int pipefd[2], int infd, const void *inbuf, size_t inlen,
+		int outfd, char **outbuf, size_t *outlen);
+
+/* pools of coprocesses: a pool keeps from minworkers up to maxworkers running
+	 instances of command, each one is used for a request/response exchange
+	 at a time. framing is EXECS_POOL_LINE (requests and responses are
+	 lines) or EXECS_POOL_LEN32 (they are preceded by their length, a 32 bit
+	 integer in network byte order).
+	 Workers are started when all the running ones are busy, idle workers
+	 beyond minworkers are retired, workers which terminate are replaced.
+	 coprocess_pool_call can be used by several threads at the same time,
+	 it returns the length of the response (stored in a NUL terminated
+	 malloc-ed buffer in *resp, if resp is not NULL) or -1 in case of error.
+	 coprocess_pool_free waits for the calls in progress to complete (calls
+	 still waiting for a worker fail with ECANCELED), then it terminates all
+	 the workers */
+#define EXECS_POOL_LINE 0
+#define EXECS_POOL_LEN32 1
+struct coprocess_pool;
+struct coprocess_pool *_coprocess_pool_new(const char *path, const char *command,
+		int framing, int minworkers, int maxworkers, int flags);
+ssize_t coprocess_pool_call(struct coprocess_pool *pool, const void *req, size_t reqlen,
+		char **resp);
+void coprocess_pool_free(struct coprocess_pool *pool);
+
+#define coprocs_pool(path, cmd, framing, min, max) \
+	_coprocess_pool_new((path),(cmd),(framing),(min),(max),EXECS_NOSEQ)
+#define coprocsp_pool(cmd, framing, min, max) \
+	_coprocess_pool_new(NULL,(cmd),(framing),(min),(max),EXECS_NOSEQ)
+
+/* asynchronous execution: these functions do not wait for the termination
+	 of the new process. They return a pidfd (see pidfd_open(2)), which becomes
+	 readable when the process terminates, so it can be added to a
+	 poll/select/epoll event loop (-1 in case of error). If pid is not NULL,
+	 *pid gets the process id.
+	 _popen_async returns the caller's end of the pipe in *pipefd, _coprocess_async
+	 returns the pipes as _coprocess_common does. Sequences and pipelines are
+	 not supported.
+	 All the descriptors have the close-on-exec flag set. */
+int _system_async(const char *path, const char *command, int redir[3], int flags, pid_t *pid);
+int _popen_async(const char *path, const char *command, const char *type, int *pipefd,
+		int flags, pid_t *pid);
+int _coprocess_async(const char *path, const char *command,
+		char *const argv[], char *const envp[], int pipefd[2], int flags, pid_t *pid);
+
+#define system_execs_async(path,cmd,pid)      _system_async((path),(cmd),NULL,EXECS_NOSEQ,(pid))
+#define system_execsp_async(cmd,pid)          _system_async(NULL,(cmd),NULL,EXECS_NOSEQ,(pid))
+#define system_execsrp_async(cmd,redir,pid)   _system_async(NULL,(cmd),(redir),EXECS_NOSEQ,(pid))
+#define popen_execs_async(path,cmd,type,pipefd,pid) \
+	_popen_async((path),(cmd),(type),(pipefd),EXECS_NOSEQ,(pid))
+#define popen_execsp_async(cmd,type,pipefd,pid) \
+	_popen_async(NULL,(cmd),(type),(pipefd),EXECS_NOSEQ,(pid))
+#define coprocs_async(path,cmd,pfd,pid) \
+	_coprocess_async((path),(cmd),NULL,environ,(pfd),EXECS_NOSEQ,(pid))
+#define coprocsp_async(cmd,pfd,pid) \
+	_coprocess_async(NULL,(cmd),NULL,environ,(pfd),EXECS_NOSEQ,(pid))
+
+/* execs_async_wait reaps the process of pidfd, closes pidfd and returns the
+	 wait status (as system(3) or waitpid(2)). options can be WNOHANG: if the
+	 process has not terminated yet it returns -1, errno=EAGAIN */
+int execs_async_wait(int pidfd, int options);
+
 /* Low level argc management functions */
 
 /* s2argv parses args.
 	 It allocates, initializes and returns an argv array, ready for execv.
 	 s2argv is able to parse several commands separated by semicolons (;).
+	 |, <, > and & are ordinary chars (e.g. s2argv("ls |") returns
+	 {"ls", "|"}): use s2multipipe to parse pipelines and redirections.
 	 The return value is the sequence of all the corresponding argv
 	 (each one has a NULL element as its terminator) and one further
 	 NULL element terminates the whole sequence.
 	 (i.e. this multi-argv has two NULLs in a row at its end).
 	 This format is compatible with the standard argv.
+	 s2argv returns NULL if there is not enough memory.
  */
 char **s2argv(const char *args);
 
@@ -161,16 +533,132 @@ size_t s2argvlen(char **argv);
 /* argv=argv+s2argc(argv)+1 is the next argv */
 size_t s2argc(char **argv);
 
+/* indexed multi-argv: direct access to the k-th command (in O(1)).
+	 s2argv_indexed parses args as s2argv does: argv is the multi-argv
+	 (s2argv layout), ncmds the number of commands and argv + start[k] is the
+	 argv of the k-th command (start[ncmds] is the offset of the final NULL).
+	 s2argv_index_cmd returns the argv of the k-th command and
+	 s2argv_index_argc its argc (NULL and 0 if k >= ncmds).
+	 s2argv_index_free deallocates the index and its argv */
+struct s2argv_index {
+	size_t ncmds;
+	size_t *start;
+	char **argv;
+};
+struct s2argv_index *s2argv_indexed(const char *args);
+void s2argv_index_free(struct s2argv_index *idx);
+char **s2argv_index_cmd(const struct s2argv_index *idx, size_t k);
+size_t s2argv_index_argc(const struct s2argv_index *idx, size_t k);
+
 /* var definition function (e.g. s2argv_getvar=getenv)*/
 typedef char * (* s2argv_getvar_t) (const char *name);
 extern s2argv_getvar_t s2argv_getvar;
 
+/* variable store: a hash table of name/value pairs. When s2argv_vars is
+	 not NULL, variables are looked up in s2argv_vars first (in O(1)), then
+	 by s2argv_getvar (if defined).
+	 execs_vars_new creates a store, defs (if not NULL) is a NULL terminated
+	 array of definitions "NAME=value" (e.g. environ).
+	 execs_vars_set defines or (value == NULL) removes a variable,
+	 execs_vars_putv applies a batch of definitions ("NAME" alone removes NAME).
+	 Values are copied. The store must not be modified while it is being used
+	 for expansion (or while the argv built by s2multiargv and
+	 s2multipipe are in use). These functions are provided by libexecs only. */
+struct execs_vars;
+extern struct execs_vars *s2argv_vars;
+struct execs_vars *execs_vars_new(char *const defs[]);
+void execs_vars_free(struct execs_vars *v);
+int execs_vars_set(struct execs_vars *v, const char *name, const char *value);
+int execs_vars_putv(struct execs_vars *v, char *const defs[]);
+const char *execs_vars_get(const struct execs_vars *v, const char *name);
+
+/* environment overlays: a base environment (NULL means environ) plus a
+	 delta of variables set or unset. execs_env_envp returns an envp for
+	 execse, execspe, coprocse, coprocvpe, the envp field of struct execs_ctx
+	 etc. It is built only when variables are added to or removed from the
+	 delta (or environ gets reallocated): the strings of the base are shared,
+	 and a new value of a variable already in the delta just replaces its entry,
+	 so spawns do not need any allocation.
+	 execs_env_set sets or (value == NULL) unsets a variable (values are copied),
+	 execs_env_reset empties the delta. execs_env_flush forces a rebuild
+	 (e.g. after setenv(3), which can change environ in place).
+	 The envp returned by execs_env_envp is valid until the next change of the
+	 overlay. These functions are provided by libexecs only. */
+struct execs_env;
+struct execs_env *execs_env_new(char *const base[]);
+void execs_env_free(struct execs_env *env);
+int execs_env_set(struct execs_env *env, const char *name, const char *value);
+void execs_env_reset(struct execs_env *env);
+void execs_env_flush(struct execs_env *env);
+char *const *execs_env_envp(struct execs_env *env);
+
 /* multi argv. Args can contain several commands semicolon (;) separated.
 	 This function parses args and calls f for each command/argv in args.
 	 If f returns 0 s2multiargv calls f for the following argv, otherwise
 	 returns the non-zero value.
+	 Pipelines and redirections are not supported, |, < and > are
+	 ordinary chars.
 	*/
 int s2multiargv(const char *args,
 		int (*f)(char **argv, void *opaque), void *opaque, int flags);
 
+/* streaming multi argv: s2multiargv_fd, s2multiargv_file and s2multiargv_mem
+	 are like s2multiargv but the commands are read from a file descriptor
+	 (regular files are mapped by mmap, the file offset is then moved as if
+	 the data had been read), from a stdio stream or from a memory
+	 area of len bytes (e.g. a mapped file, it does not need a trailing NUL).
+	 The input is split in commands at the semicolons, each command is parsed
+	 and passed to f before reading further: the memory used depends on the
+	 length of the longest command, not on the size of the input (commands
+	 longer than ARG_MAX fail, errno=E2BIG). Empty commands are skipped, NUL
+	 chars in the input are not allowed (errno=EINVAL) */
+int s2multiargv_fd(int fd,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags);
+int s2multiargv_file(FILE *stream,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags);
+int s2multiargv_mem(const void *data, size_t len,
+		int (*f)(char **argv, void *opaque), void *opaque, int flags);
+
+/* multi pipeline. s2multipipe is like s2multiargv but commands can be
+	 pipelines (e.g. "ls -l | wc"). f gets an array of argv (one for each
+	 command of the pipeline) terminated by NULL.
+	 The NULL terminating each argv is followed by the redirections of the
+	 command: pairs of operator (e.g. "<", "2>>", "2>&") and target (a file name
+	 or a descriptor number for "&" operators), and by a further NULL. */
+int s2multipipe(const char *args,
+		int (*f)(char **argv[], void *opaque), void *opaque, int flags);
+/* variables are expanded as defined by ctx */
+int _s2multipipe_ctx(const struct execs_ctx *ctx, const char *args,
+		int (*f)(char **argv[], void *opaque), void *opaque, int flags);
+/* pathname expansion (EXECS_GLOB): the sorted matches of pattern, a
+	 NULL terminated array to be freed by a single free(3).
+	 NULL if no pathname matches (errno=ENOENT) or in case of error */
+char **_execs_glob(const char *pattern);
+
+/* compiled commands: s2argv_compile parses args once (flags as in
+	 s2multiargv) and returns an immutable template. Variables are expanded
+	 by s2argv_getvar each time the template is used, so the same template can
+	 be run many times, also by several threads concurrently, with no parsing.
+	 s2multiargv_compiled and execs_run_compiled take |, <, > and & literally
+	 (as s2multiargv and execs do), s2multipipe_compiled applies pipelines and
+	 redirections (as s2multipipe does, it fails with EINVAL if args is not a
+	 valid pipeline, e.g. "ls |").
+	 s2argv_compile returns NULL in case of error (errno is EINVAL if args
+	 violates flags) */
+struct s2argv_compiled *s2argv_compile(const char *args, int flags);
+void s2argv_compiled_free(struct s2argv_compiled *t);
+
+/* s2multiargv and s2multipipe for compiled commands */
+int s2multiargv_compiled(const struct s2argv_compiled *t,
+		int (*f)(char **argv, void *opaque), void *opaque);
+int s2multipipe_compiled(const struct s2argv_compiled *t,
+		int (*f)(char **argv[], void *opaque), void *opaque);
+
+/* execve/execvpe the (first) command of a template, path as in _execs_common */
+int execs_run_compiled(const char *path, const struct s2argv_compiled *t, char *const envp[]);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,289 @@
+/*
+ * s2argv: convert strings to argv
+ * Copyright (C) 2014 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef EXECS_HPP
+#define EXECS_HPP
+#include <cstddef>
+#include <cerrno>
+#include <cstdio>
+#include <array>
+#include <utility>
+#include <execs.h>
+
+/* C++20 interface.
+	 execs::cmd<"ls -l /tmp"> parses the command at compile time: its argv
+	 is a static array built by the compiler (same syntax as s2argv, several
+	 commands can be separated by semicolons, |, <, > and & are ordinary
+	 chars). Variables need a run time parsing: they are compile time errors.
+	   execs::cmd<"ls -l /tmp">::argv()   the multi argv (as returned by s2argv)
+	   execs::cmd<"ls -l /tmp">::exec()   execvpe (or execve if path is not NULL)
+	   execs::cmd<"ls -l /tmp">::system() run the sequence of commands (as system_nosh)
+	 execs::popen_stream and execs::coprocess are RAII wrappers of the
+	 popen and coprocess functions of the C library: the stream is closed
+	 (and the process waited for) by the destructor. */
+
+namespace execs {
+
+	namespace fsa {
+		/* the FSA of args_fsa (execs.c): states, classes and actions must match
+			 (test/hppdiff compares the results with s2argv) */
+		enum : unsigned char {END, SPACE, CHAR, SGLQ, DBLQ, ESCAPE, SEMIC, VAR, PIPE, REDIR, AMP,
+			ESCVAR, DBLESC, NSTATES};
+		constexpr int NCLASSES = AMP + 1;
+		enum : unsigned char {NEWARG = 0x1, CHCOPY = 0x2, ENDARG = 0x4, ENDVAR = 0x8, ENDCMD = 0x10};
+
+		inline constexpr unsigned char nextstate[NSTATES][NCLASSES] = {
+			{END,    0,   0,   0,   0,     0,    0,   0,   0,    0,    0}, // END
+			{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // SPACE
+			{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC,CHAR,PIPE,REDIR, CHAR}, // CHAR
+			{END, SGLQ,SGLQ,CHAR,SGLQ,  SGLQ, SGLQ,SGLQ,SGLQ, SGLQ, SGLQ}, // SGLQ
+			{END, DBLQ,DBLQ,DBLQ,CHAR,DBLESC, DBLQ,DBLQ,DBLQ, DBLQ, DBLQ}, // DBLQ
+			{END, CHAR,CHAR,CHAR,CHAR,  CHAR, CHAR,CHAR,CHAR, CHAR, CHAR}, // ESCAPE
+			{END,SEMIC,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // SEMIC
+			{END,SPACE, VAR, VAR, VAR,   VAR,SEMIC, VAR,PIPE,REDIR,  VAR}, // VAR
+			{END, PIPE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR, CHAR}, // PIPE
+			{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR,PIPE,REDIR,REDIR}, // REDIR
+			{END,    0,   0,   0,   0,     0,    0,   0,   0,    0,    0}, // AMP (not a state)
+			{END,  VAR, VAR, VAR, VAR,   VAR,  VAR, VAR, VAR,  VAR,  VAR}, // ESCVAR
+			{END, DBLQ,DBLQ,DBLQ,DBLQ,  DBLQ, DBLQ,DBLQ,DBLQ, DBLQ, DBLQ}};
+
+		inline constexpr unsigned char action[NSTATES][NCLASSES] = {
+			{ENDCMD|     0,     0,            0,            0,            0,            0,            0,            0,            0,            0,            0}, //END
+			{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,       ENDCMD,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //SPACE
+			{ENDCMD|ENDARG,ENDARG,       CHCOPY,            0,            0,            0,ENDCMD|ENDARG,            0,ENDCMD|ENDARG,ENDARG|NEWARG|CHCOPY,CHCOPY}, //CHAR
+			{ENDCMD|ENDARG,CHCOPY,       CHCOPY,            0,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //SNGQ
+			{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,            0,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //DBLQ
+			{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //ESCAPE
+			{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,            0,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //SEMIC
+			{ENDCMD|ENDVAR,ENDVAR,       CHCOPY,            0,            0,            0,ENDCMD|ENDVAR,            0,ENDCMD|ENDVAR,ENDVAR|NEWARG|CHCOPY,CHCOPY}, //VAR
+			{ENDCMD|     0,     0,NEWARG|CHCOPY,       NEWARG,       NEWARG,       NEWARG,       ENDCMD,       NEWARG,       ENDCMD,NEWARG|CHCOPY,NEWARG|CHCOPY}, //PIPE
+			{ENDCMD|ENDARG,ENDARG,ENDARG|NEWARG|CHCOPY,ENDARG|NEWARG,ENDARG|NEWARG,ENDARG|NEWARG,ENDCMD|ENDARG,ENDARG|NEWARG,ENDCMD|ENDARG,CHCOPY,CHCOPY}, //REDIR
+			{            0,     0,            0,            0,            0,            0,            0,            0,            0,            0,            0}, //AMP
+			{ENDCMD|ENDVAR,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}, //ESCVAR
+			{ENDCMD|ENDARG,CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY,       CHCOPY}}; //DBLESC
+
+		constexpr unsigned char charclass(char c) {
+			switch (c) {
+				case 0: return END;
+				case ' ': case '\t': case '\n': return SPACE;
+				case '\'': return SGLQ;
+				case '"': return DBLQ;
+				case '\\': return ESCAPE;
+				case ';': return SEMIC;
+				case '$': return VAR;
+				/* |, <, > and & are literal, as in s2argv (FSA_LITERAL) */
+				default: return CHAR;
+			}
+		}
+
+		/* the result of a parsing: len chars in buf, n elements of argv
+			 (offsets in buf, -1 for NULL), error is a state which is not supported */
+		struct layout {
+			std::size_t len = 0;
+			std::size_t n = 0;
+			int error = 0;
+		};
+
+		/* args_fsa of s2argv, without variables.
+			 buf and off can be NULL (to compute the layout) */
+		constexpr layout parse(const char *args, char *buf, long *off) {
+			layout l;
+			int state = SPACE;
+			long thisarg = 0;
+			for (; state != END; args++) {
+				int cls = charclass(*args);
+				int next = nextstate[state][cls];
+				int act = action[state][cls];
+				if (next == VAR) {
+					l.error = next;
+					return l;
+				}
+				if (act & ENDARG) {
+					if (buf) buf[l.len] = 0;
+					l.len++;
+					if (off) off[l.n] = thisarg;
+					l.n++;
+				}
+				if (act & NEWARG)
+					thisarg = l.len;
+				if (act & CHCOPY) {
+					if (buf) buf[l.len] = *args;
+					l.len++;
+				}
+				if (act & ENDCMD) {
+					if (off) off[l.n] = -1;
+					l.n++;
+				}
+				state = next;
+			}
+			if (off) off[l.n] = -1;
+			l.n++;
+			return l;
+		}
+	}
+
+	template <std::size_t N>
+		struct fixed_string {
+			char s[N];
+			constexpr fixed_string(const char (&str)[N]) {
+				for (std::size_t i = 0; i < N; i++)
+					s[i] = str[i];
+			}
+		};
+
+	template <fixed_string S>
+		class cmd {
+			static constexpr fsa::layout size = fsa::parse(S.s, nullptr, nullptr);
+			static_assert(size.error != fsa::VAR, "execs::cmd: variables need s2argv");
+			struct image {
+				std::array<char, size.len + 1> buf{};
+				std::array<long, size.n> off{};
+			};
+			static constexpr image parsed = [] {
+				image i;
+				fsa::parse(S.s, i.buf.data(), i.off.data());
+				return i;
+			}();
+			/* writable copies: execve requires char *const argv[] */
+			static inline constinit std::array<char, size.len + 1> buf = parsed.buf;
+			static constexpr std::array<char *, size.n> mkargv() {
+				std::array<char *, size.n> a{};
+				for (std::size_t i = 0; i < size.n; i++)
+					a[i] = (parsed.off[i] < 0) ? nullptr : &buf[parsed.off[i]];
+				return a;
+			}
+			static inline constinit std::array<char *, size.n> argv_ = mkargv();
+
+			static int system_child(void *arg) {
+				_execs_argv(nullptr, static_cast<char **>(arg), environ, -1);
+				return 127;
+			}
+
+			public:
+			/* number of elements of the multi argv (NULLs included, see s2argvlen) */
+			static constexpr std::size_t argvlen = size.n - 1;
+
+			static char *const *argv() {
+				return argv_.data();
+			}
+
+			/* exec the (first) command, path as in _execs_common */
+			static int exec(const char *path = nullptr, char *const envp[] = environ) {
+				return _execs_argv(path, argv_.data(), envp, -1);
+			}
+
+			/* run the commands in sequence: the first failure breaks the sequence,
+				 the return value is a wait status as in system_nosh */
+			static int system() {
+				char **argv = argv_.data();
+				int status = 0;
+				for (; *argv && status == 0; argv += s2argc(argv) + 1) {
+					pid_t pid = _execs_spawn(system_child, argv, 0);
+					if (pid < 0)
+						return -1;
+					while (waitpid(pid, &status, 0) < 0)
+						if (errno != EINTR)
+							return -1;
+				}
+				return status;
+			}
+		};
+
+	/* popen/pclose: flags as in _popen_common (e.g. 0 as popen_nosh) */
+	class popen_stream {
+		FILE *stream;
+		public:
+		popen_stream(const char *command, const char *type, int flags = 0, const char *path = nullptr) :
+			stream(_popen_common(path, command, type, flags)) {}
+		popen_stream(const popen_stream &) = delete;
+		popen_stream &operator=(const popen_stream &) = delete;
+		popen_stream(popen_stream &&other) noexcept : stream(std::exchange(other.stream, nullptr)) {}
+		popen_stream &operator=(popen_stream &&other) noexcept {
+			if (this != &other) {
+				close();
+				stream = std::exchange(other.stream, nullptr);
+			}
+			return *this;
+		}
+		~popen_stream() {
+			close();
+		}
+		FILE *get() const { return stream; }
+		explicit operator bool() const { return stream != nullptr; }
+		/* the wait status of the command (-1 if the stream is not open) */
+		int close() {
+			return stream ? pclose_execs(std::exchange(stream, nullptr)) : -1;
+		}
+	};
+
+	/* coprocess: out() is the output of the command, in() its input */
+	class coprocess {
+		/* fds is initialized first: the constructors of pid fill it */
+		int fds[2] = {-1, -1};
+		pid_t pid;
+		public:
+		coprocess(const char *command, int flags = EXECS_NOSEQ, const char *path = nullptr) :
+			pid(_coprocess_common(path, command, nullptr, environ, fds, flags)) {}
+		/* no parsing at run time */
+		template <fixed_string S>
+			coprocess(cmd<S>, const char *path = nullptr) :
+				pid(_coprocess_common(path, nullptr, cmd<S>::argv(), environ, fds, 0)) {}
+		coprocess(const coprocess &) = delete;
+		coprocess &operator=(const coprocess &) = delete;
+		coprocess(coprocess &&other) noexcept :
+			fds{std::exchange(other.fds[0], -1), std::exchange(other.fds[1], -1)},
+			pid(std::exchange(other.pid, -1)) {}
+		coprocess &operator=(coprocess &&other) noexcept {
+			if (this != &other) {
+				wait();
+				pid = std::exchange(other.pid, -1);
+				fds[0] = std::exchange(other.fds[0], -1);
+				fds[1] = std::exchange(other.fds[1], -1);
+			}
+			return *this;
+		}
+		~coprocess() {
+			wait();
+		}
+		explicit operator bool() const { return pid > 0; }
+		pid_t get_pid() const { return pid; }
+		int out() const { return fds[0]; }
+		int in() const { return fds[1]; }
+		/* close the input of the command (it gets EOF) */
+		void close_in() {
+			if (fds[1] >= 0)
+				::close(std::exchange(fds[1], -1));
+		}
+		/* close the pipes and wait for the command: its wait status, or -1 */
+		int wait() {
+			int status = -1;
+			close_in();
+			if (fds[0] >= 0)
+				::close(std::exchange(fds[0], -1));
+			if (pid > 0) {
+				while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+					;
+				pid = -1;
+			}
+			return status;
+		}
+	};
+}
+
+#endif
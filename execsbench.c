@@ -0,0 +1,285 @@
+/*
+ * s2argv: convert strings to argv
+ * Copyright (C) 2014 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <execs.h>
+
+/* benchmark suite. Each line of output is a benchmark result:
+	 kind name key=value ...
+	 parse  func/input bytes= iters= sec= mbps=
+	 spawn  func rss_mb= threads= ops= sec= ops_per_sec= usec_per_op=
+	 Lines beginning with # are comments.
+
+	 usage: execsbench [-P] [-S] [-i parse_iters] [-n spawn_ops]
+	                   [-r rss_mb,...] [-t threads,...]
+	 -P: parse benchmarks only, -S: spawn benchmarks only */
+
+#define INPUTLEN (1024 * 1024)
+/* the parsing functions allocate argv on the stack */
+#define PARSE_STACKSIZE (256 * 1024 * 1024)
+#define SPAWN_CMD "/bin/true"
+#define MAXLIST 16
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* fill buf repeating item (space separated) */
+static char *mkinput(const char *item, size_t len)
+{
+	char *buf=malloc(len + 1);
+	size_t itemlen=strlen(item);
+	size_t pos=0;
+	if (buf == NULL)
+		exit(1);
+	while (pos + itemlen + 1 < len) {
+		memcpy(buf + pos, item, itemlen);
+		pos+=itemlen;
+		buf[pos++]=' ';
+	}
+	buf[pos]=0;
+	return buf;
+}
+
+static int count_argv(char **argv, void *opaque)
+{
+	size_t *count=opaque;
+	for (; *argv; argv++)
+		(*count)++;
+	return 0;
+}
+
+static int count_pipe(char **argvv[], void *opaque)
+{
+	for (; *argvv; argvv++)
+		count_argv(*argvv, opaque);
+	return 0;
+}
+
+/* parse benchmarks */
+
+enum parse_func {S2ARGV, S2MULTIARGV, S2MULTIPIPE, S2ARGV_COMPILE, NPARSE_FUNCS};
+static const char *parse_func_name[]={"s2argv", "s2multiargv", "s2multipipe", "s2argv_compile"};
+
+static void bench_parse1(enum parse_func func, const char *name, const char *input, int iters)
+{
+	size_t len=strlen(input);
+	size_t count=0;
+	double start, elapsed;
+	int i;
+	start=now();
+	for (i=0; i<iters; i++) {
+		switch (func) {
+			case S2ARGV: s2argv_free(s2argv(input));
+									 break;
+			case S2MULTIARGV: s2multiargv(input, count_argv, &count, 0);
+												break;
+			case S2MULTIPIPE: s2multipipe(input, count_pipe, &count, 0);
+												break;
+			case S2ARGV_COMPILE: s2argv_compiled_free(s2argv_compile(input, 0));
+													 break;
+			default: break;
+		}
+	}
+	elapsed=now() - start;
+	printf("parse %s/%s bytes=%zu iters=%d sec=%.6f mbps=%.2f\n", parse_func_name[func], name,
+			len, iters, elapsed, len * iters / elapsed / 1e6);
+}
+
+static void *bench_parse(void *arg)
+{
+	static const struct {
+		const char *name;
+		const char *item;
+	} inputs[]={
+		{"shortargs", "-l"},
+		{"longargs", "/usr/share/doc/s2argv-execs/examples/a-quite-long-file-name.txt"},
+		{"quoted", "'single quoted argument' \"double quoted argument\""},
+		{"escaped", "a\\ b\\ c\\ d"},
+		{"vars", "$HOME"},
+		{"sequence", "echo a;"},
+	};
+	int iters=*(int *) arg;
+	size_t i;
+	int func;
+	s2argv_getvar=getenv;
+	for (i=0; i<sizeof(inputs)/sizeof(inputs[0]); i++) {
+		char *input=mkinput(inputs[i].item, INPUTLEN);
+		for (func=0; func<NPARSE_FUNCS; func++)
+			bench_parse1(func, inputs[i].name, input, iters);
+		free(input);
+	}
+	return NULL;
+}
+
+/* spawn benchmarks: each thread runs ops spawns of SPAWN_CMD */
+
+enum spawn_func {SYSTEM_NOSH, POPEN_NOSH, COPROCS, SYSTEM, POPEN, POSIX_SPAWN, NSPAWN_FUNCS};
+static const char *spawn_func_name[]={"system_nosh", "popen_nosh", "coprocs",
+	"system", "popen", "posix_spawn"};
+
+struct spawn_arg {
+	enum spawn_func func;
+	int ops;
+};
+
+static void spawn1(enum spawn_func func)
+{
+	static char *const argv[]={SPAWN_CMD, NULL};
+	FILE *f;
+	pid_t pid;
+	int pfd[2];
+	switch (func) {
+		case SYSTEM_NOSH: system_nosh(SPAWN_CMD);
+											break;
+		case POPEN_NOSH: if ((f=popen_nosh(SPAWN_CMD, "r")) != NULL)
+											 pclose_nosh(f);
+										 break;
+		case COPROCS: if ((pid=coprocs(SPAWN_CMD, SPAWN_CMD, pfd)) > 0) {
+										close(pfd[0]);
+										close(pfd[1]);
+										waitpid(pid, NULL, 0);
+									}
+									break;
+		case SYSTEM: if (system(SPAWN_CMD) < 0)
+									 perror("system");
+								 break;
+		case POPEN: if ((f=popen(SPAWN_CMD, "r")) != NULL)
+									pclose(f);
+								break;
+		case POSIX_SPAWN: if (posix_spawn(&pid, SPAWN_CMD, NULL, NULL, argv, environ) == 0)
+												waitpid(pid, NULL, 0);
+											break;
+		default: break;
+	}
+}
+
+static void *spawn_thread(void *arg)
+{
+	struct spawn_arg *sa=arg;
+	int i;
+	for (i=0; i<sa->ops; i++)
+		spawn1(sa->func);
+	return NULL;
+}
+
+static void bench_spawn1(enum spawn_func func, int rss_mb, int nthreads, int ops)
+{
+	pthread_t threads[nthreads];
+	struct spawn_arg sa={func, ops};
+	double start, elapsed;
+	int i;
+	start=now();
+	for (i=0; i<nthreads; i++)
+		pthread_create(&threads[i], NULL, spawn_thread, &sa);
+	for (i=0; i<nthreads; i++)
+		pthread_join(threads[i], NULL);
+	elapsed=now() - start;
+	printf("spawn %s rss_mb=%d threads=%d ops=%d sec=%.6f ops_per_sec=%.1f usec_per_op=%.2f\n",
+			spawn_func_name[func], rss_mb, nthreads, ops * nthreads, elapsed,
+			ops * nthreads / elapsed, elapsed * 1e6 / (ops * nthreads));
+	fflush(stdout);
+}
+
+static void bench_spawn(int ops, int rss[], int nrss, int threads[], int nthreads)
+{
+	int r, t;
+	int func;
+	for (r=0; r<nrss; r++) {
+		/* the memory of the parent gets touched: it is really part of the RSS */
+		size_t len=(size_t) rss[r] * 1024 * 1024;
+		void *mem=NULL;
+		if (len > 0) {
+			mem=mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) {
+				printf("# rss_mb=%d: %s\n", rss[r], strerror(errno));
+				continue;
+			}
+			memset(mem, 1, len);
+		}
+		for (t=0; t<nthreads; t++) {
+			for (func=0; func<NSPAWN_FUNCS; func++)
+				bench_spawn1(func, rss[r], threads[t], ops);
+		}
+		if (mem)
+			munmap(mem, len);
+	}
+}
+
+/* parse a comma separated list of integers */
+static int parse_list(char *s, int list[])
+{
+	int n=0;
+	char *tok;
+	for (tok=strtok(s, ","); tok != NULL && n < MAXLIST; tok=strtok(NULL, ","))
+		list[n++]=atoi(tok);
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	int parse_iters=20;
+	int spawn_ops=200;
+	int rss[MAXLIST]={0, 256};
+	int nrss=2;
+	int threads[MAXLIST]={1, 4};
+	int nthreads=2;
+	int run_parse=1;
+	int run_spawn=1;
+	int c;
+	while ((c=getopt(argc, argv, "PSi:n:r:t:")) != -1) {
+		switch (c) {
+			case 'P': run_spawn=0; break;
+			case 'S': run_parse=0; break;
+			case 'i': parse_iters=atoi(optarg); break;
+			case 'n': spawn_ops=atoi(optarg); break;
+			case 'r': nrss=parse_list(optarg, rss); break;
+			case 't': nthreads=parse_list(optarg, threads); break;
+			default:
+				fprintf(stderr, "usage: %s [-P] [-S] [-i parse_iters] [-n spawn_ops] "
+						"[-r rss_mb,...] [-t threads,...]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (run_parse) {
+		pthread_t thread;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, PARSE_STACKSIZE);
+		if (pthread_create(&thread, &attr, bench_parse, &parse_iters) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+		pthread_join(thread, NULL);
+	}
+	if (run_spawn)
+		bench_spawn(spawn_ops, rss, nrss, threads, nthreads);
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * execsenv: environment overlays
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <execs.h>
+
+/* the delta is expected to be small: it is a plain array */
+#define EXECS_ENV_MINDELTA 4
+
+struct execs_env_entry {
+	char *def; // "NAME=value", or "NAME" if NAME is unset
+	size_t namelen;
+	ssize_t pos; // index of def in envp, -1 if it is not there
+};
+
+struct execs_env {
+	char *const *base; // NULL means environ
+	char *const *envpbase; // the base used to build envp
+	struct execs_env_entry *delta;
+	size_t ndelta;
+	size_t deltasize;
+	char **envp;
+	size_t envpsize;
+	int dirty;
+};
+
+#define EXECS_ENV_UNSET(e) ((e)->def[(e)->namelen] == 0)
+
+/* the entry of the delta overriding def (def is "NAME=value") */
+static struct execs_env_entry *execs_env_match(const struct execs_env *env, const char *def) {
+	size_t i;
+	for (i=0; i<env->ndelta; i++) {
+		struct execs_env_entry *e=&env->delta[i];
+		if (strncmp(def, e->def, e->namelen) == 0 && def[e->namelen] == '=')
+			return e;
+	}
+	return NULL;
+}
+
+static int execs_env_build(struct execs_env *env, char *const *base) {
+	size_t n;
+	size_t i;
+	size_t k;
+	for (n=0; base && base[n]; n++)
+		;
+	if (n + env->ndelta + 1 > env->envpsize) {
+		char **newenvp=realloc(env->envp, (n + env->ndelta + 1) * sizeof(char *));
+		if (newenvp == NULL)
+			return -1;
+		env->envp=newenvp;
+		env->envpsize=n + env->ndelta + 1;
+	}
+	for (i=0; i<env->ndelta; i++)
+		env->delta[i].pos=-1;
+	/* the entries of base are shared, overridden variables keep their position */
+	for (i=0, k=0; i<n; i++) {
+		struct execs_env_entry *e=execs_env_match(env, base[i]);
+		if (e == NULL)
+			env->envp[k++]=base[i];
+		else if (!EXECS_ENV_UNSET(e) && e->pos < 0) {
+			e->pos=k;
+			env->envp[k++]=e->def;
+		}
+	}
+	for (i=0; i<env->ndelta; i++) {
+		struct execs_env_entry *e=&env->delta[i];
+		if (!EXECS_ENV_UNSET(e) && e->pos < 0) {
+			e->pos=k;
+			env->envp[k++]=e->def;
+		}
+	}
+	env->envp[k]=NULL;
+	env->envpbase=base;
+	env->dirty=0;
+	return 0;
+}
+
+struct execs_env *execs_env_new(char *const base[]) {
+	struct execs_env *env=calloc(1, sizeof(*env));
+	if (env == NULL)
+		return NULL;
+	env->base=base;
+	env->dirty=1;
+	return env;
+}
+
+void execs_env_reset(struct execs_env *env) {
+	size_t i;
+	for (i=0; i<env->ndelta; i++)
+		free(env->delta[i].def);
+	env->ndelta=0;
+	env->dirty=1;
+}
+
+void execs_env_free(struct execs_env *env) {
+	if (env == NULL)
+		return;
+	execs_env_reset(env);
+	free(env->delta);
+	free(env->envp);
+	free(env);
+}
+
+void execs_env_flush(struct execs_env *env) {
+	env->dirty=1;
+}
+
+int execs_env_set(struct execs_env *env, const char *name, const char *value) {
+	struct execs_env_entry *e;
+	size_t namelen;
+	size_t valuelen;
+	char *def;
+	size_t i;
+	if (name == NULL || *name == 0 || strchr(name, '=') != NULL)
+		return errno = EINVAL, -1;
+	namelen=strlen(name);
+	valuelen=value ? strlen(value) : 0;
+	for (i=0, e=NULL; i<env->ndelta; i++) {
+		if (env->delta[i].namelen == namelen && strncmp(env->delta[i].def, name, namelen) == 0) {
+			e=&env->delta[i];
+			/* nothing changed: envp is still valid */
+			if (value ? (!EXECS_ENV_UNSET(e) && strcmp(e->def + namelen + 1, value) == 0) :
+					EXECS_ENV_UNSET(e))
+				return 0;
+			break;
+		}
+	}
+	if ((def=malloc(namelen + valuelen + 2)) == NULL)
+		return -1;
+	memcpy(def, name, namelen);
+	def[namelen]=0;
+	if (value) {
+		def[namelen]='=';
+		memcpy(def + namelen + 1, value, valuelen + 1);
+	}
+	if (e == NULL) {
+		if (env->ndelta == env->deltasize) {
+			size_t newsize=env->deltasize ? 2 * env->deltasize : EXECS_ENV_MINDELTA;
+			struct execs_env_entry *newdelta=realloc(env->delta, newsize * sizeof(*newdelta));
+			if (newdelta == NULL) {
+				free(def);
+				return -1;
+			}
+			env->delta=newdelta;
+			env->deltasize=newsize;
+		}
+		e=&env->delta[env->ndelta++];
+		e->namelen=namelen;
+		e->pos=-1;
+		env->dirty=1;
+	} else {
+		/* a new value for a variable already in envp: no need to rebuild it */
+		if (value && !env->dirty && e->pos >= 0)
+			env->envp[e->pos]=def;
+		else
+			env->dirty=1;
+		free(e->def);
+	}
+	e->def=def;
+	return 0;
+}
+
+char *const *execs_env_envp(struct execs_env *env) {
+	char *const *base=env->base ? env->base : environ;
+	if ((env->dirty || env->envpbase != base) && execs_env_build(env, base) < 0)
+		return NULL;
+	return env->envp;
+}
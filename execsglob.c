@@ -0,0 +1,261 @@
+/*
+ * execsglob: pathname expansion
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <execs.h>
+
+/* directory listings are cached: an entry is valid while the mtime of the
+	 directory does not change. Listings of directories modified in the last
+	 EXECS_GLOB_RACY seconds are not cached: a further change in the same
+	 tick of the clock of the file system would go unnoticed */
+#define EXECS_GLOB_CACHESIZE 64
+#define EXECS_GLOB_RACY 2
+
+/* a listing is a single block: the header, the (sorted) names and the strings */
+struct execs_glob_listing {
+	int refs;
+	size_t n;
+	char **names;
+};
+
+struct execs_glob_dir {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	unsigned long lastuse;
+	struct execs_glob_listing *listing;
+};
+
+static struct execs_glob_dir glob_cache[EXECS_GLOB_CACHESIZE];
+static unsigned long glob_clock;
+static pthread_mutex_t glob_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+/* the matching pathnames: a sequence of NUL terminated strings */
+struct execs_glob_result {
+	char *buf;
+	size_t len;
+	size_t size;
+	size_t n;
+};
+
+static int glob_namecmp(const void *a, const void *b) {
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static struct execs_glob_listing *glob_readdir(const char *path) {
+	DIR *dir=opendir(path);
+	struct dirent *de;
+	struct execs_glob_listing *l=NULL;
+	char *buf=NULL;
+	size_t len=0;
+	size_t size=0;
+	size_t n=0;
+	if (dir == NULL)
+		return NULL;
+	while ((de=readdir(dir)) != NULL) {
+		size_t namelen=strlen(de->d_name) + 1;
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		if (len + namelen > size) {
+			size_t newsize=size ? 2 * size : 4096;
+			char *newbuf;
+			while (len + namelen > newsize)
+				newsize*=2;
+			if ((newbuf=realloc(buf, newsize)) == NULL)
+				goto err;
+			buf=newbuf;
+			size=newsize;
+		}
+		memcpy(buf + len, de->d_name, namelen);
+		len+=namelen;
+		n++;
+	}
+	if ((l=malloc(sizeof(*l) + n * sizeof(char *) + len)) != NULL) {
+		char *s=(char *) ((char **) (l + 1) + n);
+		size_t i;
+		l->refs=1;
+		l->n=n;
+		l->names=(char **) (l + 1);
+		if (len > 0)
+			memcpy(s, buf, len);
+		for (i=0; i<n; i++) {
+			l->names[i]=s;
+			s+=strlen(s) + 1;
+		}
+		qsort(l->names, n, sizeof(char *), glob_namecmp);
+	}
+err:
+	free(buf);
+	closedir(dir);
+	return l;
+}
+
+static void glob_put(struct execs_glob_listing *l) {
+	pthread_mutex_lock(&glob_mutex);
+	if (--l->refs == 0)
+		free(l);
+	pthread_mutex_unlock(&glob_mutex);
+}
+
+/* the listing of path, from the cache if it is up to date.
+	 The caller must release it by glob_put */
+static struct execs_glob_listing *glob_get(const char *path) {
+	struct stat sbuf;
+	struct execs_glob_dir *d=NULL;
+	struct execs_glob_listing *l;
+	int i;
+	if (stat(path, &sbuf) < 0 || !S_ISDIR(sbuf.st_mode))
+		return NULL;
+	pthread_mutex_lock(&glob_mutex);
+	for (i=0; i<EXECS_GLOB_CACHESIZE; i++) {
+		struct execs_glob_dir *this=&glob_cache[i];
+		if (this->listing && this->dev == sbuf.st_dev && this->ino == sbuf.st_ino) {
+			d=this;
+			break;
+		}
+		/* otherwise the empty or the least recently used entry gets replaced */
+		if (d == NULL || (d->listing && (this->listing == NULL || this->lastuse < d->lastuse)))
+			d=this;
+	}
+	if (d->listing && d->dev == sbuf.st_dev && d->ino == sbuf.st_ino &&
+			d->mtime.tv_sec == sbuf.st_mtim.tv_sec && d->mtime.tv_nsec == sbuf.st_mtim.tv_nsec) {
+		d->lastuse=++glob_clock;
+		d->listing->refs++;
+		pthread_mutex_unlock(&glob_mutex);
+		return d->listing;
+	}
+	pthread_mutex_unlock(&glob_mutex);
+	if ((l=glob_readdir(path)) == NULL)
+		return NULL;
+	if (time(NULL) - sbuf.st_mtim.tv_sec > EXECS_GLOB_RACY) {
+		pthread_mutex_lock(&glob_mutex);
+		/* d may have been reused in the meanwhile: it is replaced anyway */
+		if (d->listing && --d->listing->refs == 0)
+			free(d->listing);
+		d->dev=sbuf.st_dev;
+		d->ino=sbuf.st_ino;
+		d->mtime=sbuf.st_mtim;
+		d->lastuse=++glob_clock;
+		d->listing=l;
+		l->refs++;
+		pthread_mutex_unlock(&glob_mutex);
+	}
+	return l;
+}
+
+static int glob_add(struct execs_glob_result *r, const char *s1, size_t len1, const char *s2) {
+	size_t len2=strlen(s2) + 1;
+	if (r->len + len1 + len2 > r->size) {
+		size_t newsize=r->size ? 2 * r->size : 4096;
+		char *newbuf;
+		while (r->len + len1 + len2 > newsize)
+			newsize*=2;
+		if ((newbuf=realloc(r->buf, newsize)) == NULL)
+			return -1;
+		r->buf=newbuf;
+		r->size=newsize;
+	}
+	memcpy(r->buf + r->len, s1, len1);
+	memcpy(r->buf + r->len + len1, s2, len2);
+	r->len+=len1 + len2;
+	r->n++;
+	return 0;
+}
+
+/* expand pattern (relative to dir, which is empty or ends by '/') */
+static int glob_expand(const char *dir, const char *pattern, struct execs_glob_result *r) {
+	size_t dirlen=strlen(dir);
+	const char *comp=pattern;
+	const char *end;
+	struct execs_glob_listing *l;
+	size_t i;
+	int rv=0;
+	/* skip the leading components which are not patterns */
+	for (;;) {
+		end=strchrnul(comp, '/');
+		if (memchr(comp, '*', end - comp) || memchr(comp, '?', end - comp) ||
+				memchr(comp, '[', end - comp))
+			break;
+		if (*end == 0) {
+			struct stat sbuf;
+			char path[dirlen + strlen(pattern) + 1];
+			stpcpy(stpcpy(path, dir), pattern);
+			return (lstat(path, &sbuf) == 0) ? glob_add(r, "", 0, path) : 0;
+		}
+		comp=end + 1;
+	}
+	char prefix[dirlen + (comp - pattern) + 2];
+	char match[end - comp + 1];
+	memcpy(stpcpy(prefix, dir), pattern, comp - pattern);
+	prefix[dirlen + (comp - pattern)]=0;
+	memcpy(match, comp, end - comp);
+	match[end - comp]=0;
+	if ((l=glob_get(*prefix ? prefix : ".")) == NULL)
+		return 0;
+	for (i=0; i<l->n; i++) {
+		if (fnmatch(match, l->names[i], FNM_PERIOD) != 0)
+			continue;
+		if (*end == 0)
+			rv=glob_add(r, prefix, strlen(prefix), l->names[i]);
+		else {
+			char subdir[strlen(prefix) + strlen(l->names[i]) + 2];
+			stpcpy(stpcpy(stpcpy(subdir, prefix), l->names[i]), "/");
+			rv=glob_expand(subdir, end + 1, r);
+		}
+		if (rv < 0)
+			break;
+	}
+	glob_put(l);
+	return rv;
+}
+
+char **_execs_glob(const char *pattern) {
+	struct execs_glob_result r={NULL, 0, 0, 0};
+	char **matches=NULL;
+	int rv;
+	if (*pattern == '/')
+		rv=glob_expand("/", pattern + 1, &r);
+	else
+		rv=glob_expand("", pattern, &r);
+	if (rv < 0)
+		errno=ENOMEM;
+	else if (r.n == 0)
+		errno=ENOENT;
+	else if ((matches=malloc((r.n + 1) * sizeof(char *) + r.len)) != NULL) {
+		char *s=(char *) (matches + r.n + 1);
+		size_t i;
+		memcpy(s, r.buf, r.len);
+		for (i=0; i<r.n; i++) {
+			matches[i]=s;
+			s+=strlen(s) + 1;
+		}
+		matches[r.n]=NULL;
+	}
+	free(r.buf);
+	return matches;
+}
@@ -0,0 +1,199 @@
+/*
+ * execsvars: variable store for $VAR expansion
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <execs.h>
+
+/* open addressing, linear probing. The table is never more than 3/4 full */
+#define EXECS_VARS_MINSIZE 16
+
+struct execs_vars_entry {
+	unsigned int hash;
+	char *name; // "name\0value": a single allocation
+	char *value;
+};
+
+struct execs_vars {
+	size_t size; // a power of 2
+	size_t count;
+	struct execs_vars_entry *table;
+};
+
+struct execs_vars *s2argv_vars;
+
+static unsigned int execs_vars_hash(const char *s, size_t len) {
+	unsigned int hash=2166136261u;
+	for (; len > 0; s++, len--)
+		hash=(hash ^ (unsigned char) *s) * 16777619u;
+	return hash;
+}
+
+/* the entry of name, or the empty entry where name should be added */
+static struct execs_vars_entry *execs_vars_find(const struct execs_vars *v,
+		const char *name, size_t len, unsigned int hash) {
+	size_t mask=v->size - 1;
+	size_t i;
+	for (i=hash & mask; v->table[i].name != NULL; i=(i + 1) & mask) {
+		struct execs_vars_entry *e=&v->table[i];
+		if (e->hash == hash && strncmp(e->name, name, len) == 0 && e->name[len] == 0)
+			return e;
+	}
+	return &v->table[i];
+}
+
+static int execs_vars_resize(struct execs_vars *v, size_t size) {
+	struct execs_vars_entry *oldtable=v->table;
+	size_t oldsize=v->size;
+	size_t i;
+	if ((v->table=calloc(size, sizeof(*v->table))) == NULL) {
+		v->table=oldtable;
+		return -1;
+	}
+	v->size=size;
+	for (i=0; i<oldsize; i++) {
+		if (oldtable[i].name) {
+			struct execs_vars_entry *e=&v->table[oldtable[i].hash & (size - 1)];
+			while (e->name)
+				e=(e == &v->table[size - 1]) ? v->table : e + 1;
+			*e=oldtable[i];
+		}
+	}
+	free(oldtable);
+	return 0;
+}
+
+/* remove e, moving back the following entries of its cluster
+	 (no tombstones are needed) */
+static void execs_vars_remove(struct execs_vars *v, struct execs_vars_entry *e) {
+	size_t mask=v->size - 1;
+	size_t hole=e - v->table;
+	size_t i;
+	free(e->name);
+	for (i=(hole + 1) & mask; v->table[i].name != NULL; i=(i + 1) & mask) {
+		size_t home=v->table[i].hash & mask;
+		/* the entry can fill the hole if its home is not in (hole, i] */
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			v->table[hole]=v->table[i];
+			hole=i;
+		}
+	}
+	v->table[hole].name=NULL;
+	v->count--;
+}
+
+static int execs_vars_setn(struct execs_vars *v, const char *name, size_t len,
+		const char *value) {
+	unsigned int hash=execs_vars_hash(name, len);
+	struct execs_vars_entry *e=execs_vars_find(v, name, len, hash);
+	char *newname;
+	size_t valuelen;
+	if (value == NULL) {
+		if (e->name)
+			execs_vars_remove(v, e);
+		return 0;
+	}
+	valuelen=strlen(value);
+	if ((newname=malloc(len + valuelen + 2)) == NULL)
+		return -1;
+	memcpy(newname, name, len);
+	newname[len]=0;
+	memcpy(newname + len + 1, value, valuelen + 1);
+	if (e->name == NULL) {
+		if (4 * (v->count + 1) > 3 * v->size) {
+			if (execs_vars_resize(v, 2 * v->size) < 0) {
+				free(newname);
+				return -1;
+			}
+			e=execs_vars_find(v, name, len, hash);
+		}
+		v->count++;
+	} else
+		free(e->name);
+	e->hash=hash;
+	e->name=newname;
+	e->value=newname + len + 1;
+	return 0;
+}
+
+struct execs_vars *execs_vars_new(char *const defs[]) {
+	struct execs_vars *v=malloc(sizeof(*v));
+	if (v == NULL)
+		return NULL;
+	v->size=EXECS_VARS_MINSIZE;
+	v->count=0;
+	if ((v->table=calloc(v->size, sizeof(*v->table))) == NULL) {
+		free(v);
+		return NULL;
+	}
+	if (defs && execs_vars_putv(v, defs) < 0) {
+		execs_vars_free(v);
+		return NULL;
+	}
+	return v;
+}
+
+void execs_vars_free(struct execs_vars *v) {
+	size_t i;
+	if (v == NULL)
+		return;
+	for (i=0; i<v->size; i++)
+		free(v->table[i].name);
+	free(v->table);
+	free(v);
+}
+
+int execs_vars_set(struct execs_vars *v, const char *name, const char *value) {
+	if (name == NULL || *name == 0 || strchr(name, '=') != NULL)
+		return errno = EINVAL, -1;
+	return execs_vars_setn(v, name, strlen(name), value);
+}
+
+int execs_vars_putv(struct execs_vars *v, char *const defs[]) {
+	size_t n;
+	size_t i;
+	/* grow the table once for the whole batch */
+	for (n=0; defs[n]; n++)
+		;
+	if (4 * (v->count + n) > 3 * v->size) {
+		size_t size=v->size;
+		while (4 * (v->count + n) > 3 * size)
+			size*=2;
+		if (execs_vars_resize(v, size) < 0)
+			return -1;
+	}
+	for (i=0; i<n; i++) {
+		char *eq=strchr(defs[i], '=');
+		size_t len=eq ? (size_t) (eq - defs[i]) : strlen(defs[i]);
+		if (len == 0)
+			continue;
+		if (execs_vars_setn(v, defs[i], len, eq ? eq + 1 : NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+const char *execs_vars_get(const struct execs_vars *v, const char *name) {
+	size_t len=strlen(name);
+	struct execs_vars_entry *e=execs_vars_find(v, name, len, execs_vars_hash(name, len));
+	return e->name ? e->value : NULL;
+}
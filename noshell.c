@@ -20,150 +20,954 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
 #include <execs.h>
 
+static int execs_pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	return errno = ENOSYS, -1;
+#endif
+}
+
 struct system_execsq_t {
 	const char *path;
 	int *redir;
 	int flags;
+	const struct execs_ctx *ctx;
 };
 
-static int system_execsq_f(char **argv, void *arg) {
-	struct system_execsq_t *v=arg;
-	int status;
+/* the environment of the new processes */
+static char *const *noshell_envp(const struct execs_ctx *ctx) {
+	return (ctx && ctx->envp) ? ctx->envp : environ;
+}
+
+/* the child processes created by the library. fds[i] (if not negative)
+	 becomes the descriptor i of the child (i=0,1,2), then the child runs argv.
+	 path has the same meaning as in _execs_common. When path is NULL,
+	 file (or argv[0] if file is NULL) is searched along $PATH */
+struct noshell_child_t {
+	const char *path;
+	const char *file;
+	char *const *argv;
+	char *const *envp;
+	int fds[3];
+	int pathfd;
+	int execfd; // instrumentation: the exec status pipe, see noshell_spawn
+	const struct execs_ctx *ctx; // NULL: global settings
+	pid_t pgid; // process group: 0 unchanged, -1 a new group, >0 join pgid
+};
+
+/* the spawn server runs the global fork_security hook */
+static int noshell_use_server(const struct execs_ctx *ctx) {
+	if (ctx == NULL)
+		return !(execs_spawn_mode & EXECS_SPAWN_NOSERVER);
+	return !(ctx->spawn_mode & EXECS_SPAWN_NOSERVER) &&
+		ctx->fork_security == execs_fork_security &&
+		ctx->fork_security_arg == execs_fork_security_arg;
+}
+
+int _execs_child_exec(const char *path, const char *file, char *const argv[],
+		char *const envp[], const int fds[3], int pathfd) {
+	int i;
+	for (i=0; i<3; i++) {
+		if (fds[i] >= 0 && fds[i] != i && dup2(fds[i], i) < 0)
+			return -1;
+	}
+	for (i=0; i<3; i++) {
+		if (fds[i] > STDERR_FILENO)
+			close(fds[i]);
+	}
+	if (file && path == NULL) {
+		if (pathfd >= 0)
+			fexecve(pathfd, argv, envp);
+		return execvpe(file, argv, envp);
+	} else
+		return _execs_argv(path, argv, envp, pathfd);
+}
+
+static int noshell_child(void *arg) {
+	struct noshell_child_t *c=arg;
+	int err;
+	if (c->pgid == 0 || setpgid(0, (c->pgid > 0) ? c->pgid : 0) == 0)
+		_execs_child_exec(c->path, c->file, c->argv, c->envp, c->fds, c->pathfd);
+	err=errno;
+	/* exec failed: report errno to the instrumentation */
+	if (c->execfd >= 0 && write(c->execfd, &err, sizeof(err)) < 0)
+		return 127;
+	return 127;
+}
+
+/* instrumentation: the child gets the write end of a close-on-exec pipe,
+	 so the read end returns EOF when the child execs (or the errno of exec) */
+static pid_t noshell_spawn_stats(struct noshell_child_t *c) {
+	struct execs_stats stats={EXECS_STATS_SPAWN};
+	long long start=_execs_stats_clock();
+	int execpipe[2];
+	int err;
+	if (pipe2(execpipe, O_CLOEXEC) < 0)
+		execpipe[0]=execpipe[1]=-1;
+	else if (execpipe[0] <= STDERR_FILENO || execpipe[1] <= STDERR_FILENO) {
+		/* the std descriptors of the child get replaced */
+		close(execpipe[0]);
+		close(execpipe[1]);
+		execpipe[0]=execpipe[1]=-1;
+	}
+	c->execfd=execpipe[1];
+	/* the spawn server cannot set the process group */
+	if (c->pgid == 0 && noshell_use_server(c->ctx) &&
+			((stats.pid=_execs_server_spawn(c->path, c->file, c->argv, c->envp, c->fds, c->pathfd)) != -1 ||
+			 errno != ENOTCONN)) {
+		/* the spawn server does not forward the exec status pipe */
+		if (execpipe[0] >= 0) {
+			close(execpipe[0]);
+			execpipe[0]=-1;
+		}
+	} else
+		stats.pid=_execs_spawn_ctx(c->ctx, noshell_child, c, 0);
+	stats.spawn_ns=_execs_stats_clock() - start;
+	stats.exec_ns=-1;
+	if (execpipe[1] >= 0)
+		close(execpipe[1]);
+	if (execpipe[0] >= 0) {
+		ssize_t n;
+		while ((n=read(execpipe[0], &err, sizeof(err))) < 0 && errno == EINTR)
+			;
+		if (n == 0 && stats.pid != -1)
+			stats.exec_ns=_execs_stats_clock() - start;
+		close(execpipe[0]);
+	}
+	if (stats.pid != -1) {
+		stats.argv=c->argv;
+		_execs_stats_emit(&stats);
+	}
+	return stats.pid;
+}
+
+static pid_t noshell_spawn(struct noshell_child_t *c) {
 	pid_t pid;
-	switch (pid=fork()) {
-		case -1:
+	c->pathfd=(c->path) ? -1 : _execs_path_lookup(c->file ? c->file : c->argv[0], 0);
+	c->execfd=-1;
+	if (EXECS_STATS_ENABLED(spawn)) {
+		int saved_errno;
+		pid=noshell_spawn_stats(c);
+		saved_errno=errno;
+		if (c->pathfd >= 0)
+			close(c->pathfd);
+		errno=saved_errno;
+		return pid;
+	}
+	if (c->pgid != 0 || !noshell_use_server(c->ctx) ||
+			((pid=_execs_server_spawn(c->path, c->file, c->argv, c->envp, c->fds, c->pathfd)) == -1 &&
+			 errno == ENOTCONN))
+		pid=_execs_spawn_ctx(c->ctx, noshell_child, c, 0);
+	if (c->pathfd >= 0)
+		close(c->pathfd);
+	return pid;
+}
+
+/* waitpid (restarted on EINTR). The termination is reported to the instrumentation */
+static pid_t noshell_waitpid(pid_t pid, int *status, int options) {
+	pid_t rv;
+	if (EXECS_STATS_ENABLED(exit)) {
+		struct execs_stats stats={EXECS_STATS_EXIT, pid};
+		long long start=_execs_stats_clock();
+		while ((rv=wait4(pid, &stats.status, options, &stats.rusage)) == -1 && errno == EINTR)
+			;
+		if (rv == pid) {
+			stats.wait_ns=_execs_stats_clock() - start;
+			_execs_stats_emit(&stats);
+			if (status)
+				*status=stats.status;
+		}
+	} else {
+		while ((rv=waitpid(pid, status, options)) == -1 && errno == EINTR)
+			;
+	}
+	return rv;
+}
+
+static pid_t noshell_wait(pid_t pid, int *status) {
+	return noshell_waitpid(pid, status, 0);
+}
+
+static void noshell_redir(struct noshell_child_t *c, const int redir[3]) {
+	int i;
+	for (i=0; i<3; i++)
+		c->fds[i]=(redir) ? redir[i] : -1;
+}
+
+/* apply the redirections of a command (operator and target pairs, see
+	 s2multipipe) to c->fds. The new descriptors are stored in owned[], too:
+	 the caller must close them after the spawn */
+static int noshell_redirect(struct noshell_child_t *c, char **redir, int owned[3]) {
+	for (; *redir; redir+=2) {
+		const char *op=redir[0];
+		const char *target=redir[1];
+		int fd=-1;
+		int oflags;
+		int newfd;
+		/* the syntax of op has been checked by the parser */
+		if (*op >= '0' && *op <= '2')
+			fd=*op++ - '0';
+		if (*op == '<') {
+			if (fd < 0) fd=STDIN_FILENO;
+			oflags=O_RDONLY;
+		} else {
+			if (fd < 0) fd=STDOUT_FILENO;
+			oflags=(op[1] == '>') ? O_WRONLY | O_CREAT | O_APPEND : O_WRONLY | O_CREAT | O_TRUNC;
+		}
+		if (op[1] == '&') {
+			int srcfd;
+			if (target[0] < '0' || target[0] > '2' || target[1] != 0)
+				return errno = EBADF, -1;
+			srcfd=target[0] - '0';
+			if (c->fds[srcfd] >= 0)
+				srcfd=c->fds[srcfd];
+			newfd=fcntl(srcfd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+		} else
+			newfd=open(target, oflags | O_CLOEXEC, 0666);
+		if (newfd < 0)
 			return -1;
-		case 0:
-			if (__builtin_expect(execs_fork_security && execs_fork_security(execs_fork_security_arg) != 0, 0))
-				_exit(127);
-			if (v->redir) {
-				int i;
-				for (i=0; i<3; i++) {
-					if (v->redir[i] >= 0 && v->redir[i] != i) {
-						dup2(v->redir[i],i);
-						close(v->redir[i]);
+		if (owned[fd] >= 0)
+			close(owned[fd]);
+		owned[fd]=c->fds[fd]=newfd;
+	}
+	return 0;
+}
+
+/* spawn the commands of a pipeline: the first command reads from c->fds[0],
+	 the last one writes to c->fds[1], all of them use c->fds[2].
+	 Then the redirections of each command are applied.
+	 pids[i] is the pid of the i-th command (-1 if it could not be started) */
+static void noshell_pipeline(struct noshell_child_t *c, char **argvv[], pid_t pids[]) {
+	int infd=c->fds[0];
+	pid_t pgid=c->pgid;
+	int i;
+	for (i=0; argvv[i]; i++) {
+		struct noshell_child_t stage=*c;
+		int pfd[2]={-1, -1};
+		int owned[3]={-1, -1, -1};
+		int j;
+		if (argvv[i+1] && pipe2(pfd, O_CLOEXEC) < 0) {
+			if (i > 0)
+				close(infd);
+			for (; argvv[i]; i++)
+				pids[i]=-1;
+			return;
+		}
+		stage.argv=argvv[i];
+		stage.pgid=pgid;
+		stage.fds[0]=infd;
+		if (argvv[i+1])
+			stage.fds[1]=pfd[1];
+		if (noshell_redirect(&stage, argvv[i] + s2argc(argvv[i]) + 1, owned) < 0)
+			pids[i]=-1;
+		else
+			pids[i]=noshell_spawn(&stage);
+		/* the first command leads the new process group. setpgid is called by
+			 the parent, too: the group must exist when the next command joins it */
+		if (pgid != 0 && pids[i] != -1) {
+			if (pgid == -1)
+				pgid=pids[i];
+			setpgid(pids[i], pgid);
+		}
+		for (j=0; j<3; j++) {
+			if (owned[j] >= 0)
+				close(owned[j]);
+		}
+		if (i > 0)
+			close(infd);
+		if (argvv[i+1])
+			close(pfd[1]);
+		infd=pfd[0];
+	}
+}
+
+/* wait for all the commands of a pipeline, return the wait status of the last one
+	 (-1 if it was not started) */
+static int noshell_pipeline_wait(const pid_t pids[], int n) {
+	int status=-1;
+	int i;
+	for (i=0; i<n; i++) {
+		int stagestatus;
+		pid_t waitrv=-1;
+		if (pids[i] != -1)
+			waitrv=noshell_wait(pids[i], &stagestatus);
+		if (i == n-1 && waitrv != -1)
+			status=stagestatus;
+	}
+	return status;
+}
+
+/* deadlines (in ms, CLOCK_MONOTONIC) */
+/* time given to the commands to terminate after SIGTERM, then SIGKILL is sent */
+#define NOSHELL_KILL_GRACE 100
+/* polling period when pidfds are not available */
+#define NOSHELL_WAIT_TICK 10
+
+static long long noshell_clock_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static long long noshell_deadline(int timeout) {
+	return (timeout < 0) ? -1 : noshell_clock_ms() + timeout;
+}
+
+/* as noshell_pipeline_wait, but the commands still running at the deadline
+	 (-1: no deadline) get SIGTERM, then SIGKILL after NOSHELL_KILL_GRACE ms.
+	 If pgroup is not zero the signals are sent to the process group of the
+	 pipeline (its leader is the first command, see noshell_pipeline).
+	 *timedout is set if the commands got killed */
+static int noshell_pipeline_wait_deadline(const pid_t pids[], int n, int pgroup,
+		long long deadline, int *timedout) {
+	struct pollfd pfd[n];
+	pid_t live[n];
+	int status=-1;
+	int running=0;
+	int tick=0;
+	int sig=SIGTERM;
+	pid_t pgid=-1;
+	int i;
+	for (i=0; i<n; i++) {
+		live[i]=pids[i];
+		pfd[i].fd=-1;
+		pfd[i].events=POLLIN;
+		if (pids[i] != -1) {
+			if (pgid == -1)
+				pgid=pids[i];
+			running++;
+			if ((pfd[i].fd=execs_pidfd_open(pids[i])) < 0)
+				tick=1;
+		}
+	}
+	while (running > 0) {
+		int timeout=-1;
+		if (deadline >= 0) {
+			long long left=deadline - noshell_clock_ms();
+			if (left <= 0) {
+				*timedout=1;
+				if (pgroup)
+					kill(-pgid, sig);
+				else {
+					for (i=0; i<n; i++) {
+						if (live[i] != -1)
+							kill(live[i], sig);
 					}
 				}
+				deadline=(sig == SIGKILL) ? -1 : noshell_clock_ms() + NOSHELL_KILL_GRACE;
+				sig=SIGKILL;
+				continue;
 			}
-			if (v->path) {
-				if (*v->path)
-					execv(v->path, argv);
-				else if (argv[0][0] == '/')
-					execv(argv[0], argv);
-				else
-					_exit(127);
-			} else
-				execvp(argv[0], argv);
-			_exit(127);
-		default:
-			waitpid(pid,&status,0);
-			return status;
+			timeout=(left > INT_MAX) ? INT_MAX : left;
+		}
+		if (tick && (timeout < 0 || timeout > NOSHELL_WAIT_TICK))
+			timeout=NOSHELL_WAIT_TICK;
+		/* if poll fails, all the commands are checked */
+		int polled=poll(pfd, n, timeout);
+		for (i=0; i<n; i++) {
+			int stagestatus;
+			if (live[i] != -1 && (polled < 0 || pfd[i].fd < 0 || pfd[i].revents) &&
+					noshell_waitpid(live[i], &stagestatus, WNOHANG) == live[i]) {
+				if (i == n-1)
+					status=stagestatus;
+				if (pfd[i].fd >= 0)
+					close(pfd[i].fd);
+				pfd[i].fd=-1;
+				live[i]=-1;
+				running--;
+			}
+		}
 	}
+	return status;
+}
+
+static int system_execsq_f(char **argvv[], void *arg) {
+	struct system_execsq_t *v=arg;
+	struct noshell_child_t c={v->path, NULL, NULL, noshell_envp(v->ctx)};
+	int n;
+	for (n=0; argvv[n]; n++)
+		;
+	pid_t pids[n];
+	c.ctx=v->ctx;
+	noshell_redir(&c, v->redir);
+	noshell_pipeline(&c, argvv, pids);
+	return noshell_pipeline_wait(pids, n);
 }
 
 int _system_common(const char *path, const char *command, int redir[3], int flags) {
-	struct system_execsq_t seqexec_var={path, redir, flags};
+	return _system_common_ctx(NULL, path, command, redir, flags);
+}
+
+int _system_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *command, int redir[3], int flags) {
+	if (ctx)
+		flags |= ctx->flags;
+	struct system_execsq_t seqexec_var={path, redir, flags, ctx};
 	if (command) {
-		int rv = s2multiargv(command, system_execsq_f, &seqexec_var, flags);
+		int rv = _s2multipipe_ctx(ctx, command, system_execsq_f, &seqexec_var, flags);
 		return (rv == -1) ? W_EXITCODE(127, 0) : rv;
 	} else
 		return 1;
 }
 
-pid_t _coprocess_common(const char *path, const char *command,
-		char *const argv[], char *const envp[], int pipefd[2], int flags) {
+int _system_compiled(const char *path, const struct s2argv_compiled *t, int redir[3]) {
+	struct system_execsq_t seqexec_var={path, redir, 0};
+	if (t) {
+		int rv = s2multipipe_compiled(t, system_execsq_f, &seqexec_var);
+		return (rv == -1) ? W_EXITCODE(127, 0) : rv;
+	} else
+		return 1;
+}
+
+/* sequences and pipelines run in their own process groups, so that
+	 the signals reach all their commands (and the processes they started) */
+struct system_deadline_t {
+	struct system_execsq_t seq;
+	long long deadline;
+	int timedout;
+};
+
+static int system_deadline_f(char **argvv[], void *arg) {
+	struct system_deadline_t *v=arg;
+	struct noshell_child_t c={v->seq.path, NULL, NULL, noshell_envp(v->seq.ctx)};
+	int n;
+	for (n=0; argvv[n]; n++)
+		;
+	pid_t pids[n];
+	int pgroup=(n > 1 || !(v->seq.flags & EXECS_NOSEQ));
+	c.ctx=v->seq.ctx;
+	c.pgid=(pgroup) ? -1 : 0;
+	noshell_redir(&c, v->seq.redir);
+	noshell_pipeline(&c, argvv, pids);
+	n=noshell_pipeline_wait_deadline(pids, n, pgroup, v->deadline, &v->timedout);
+	return (v->timedout) ? -1 : n;
+}
+
+int _system_deadline(const char *path, const char *command, int redir[3], int flags,
+		int timeout) {
+	return _system_deadline_ctx(NULL, path, command, redir, flags, timeout);
+}
+
+int _system_deadline_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, int redir[3], int flags, int timeout) {
+	if (ctx)
+		flags |= ctx->flags;
+	struct system_deadline_t v={{path, redir, flags, ctx}, noshell_deadline(timeout), 0};
 	if (command) {
+		int rv = _s2multipipe_ctx(ctx, command, system_deadline_f, &v, flags);
+		if (v.timedout)
+			return errno = ETIMEDOUT, -1;
+		return (rv == -1) ? W_EXITCODE(127, 0) : rv;
+	} else
+		return 1;
+}
+
+/* parallel execution of sequences */
+
+
+struct system_parallel_job_t {
+	pid_t pid;
+	int pidfd;
+	int index;
+};
+
+struct system_parallel_t {
+	struct system_execsq_t seq;
+	struct system_parallel_job_t *jobs;
+	int maxjobs;
+	int njobs;
+	int ncmds;
+	int *status;
+	int nstatus;
+	int failindex;
+	int failstatus;
+	struct pollfd *pfd; // maxjobs elements, used by system_parallel_reap
+};
+
+/* jobs and pfd are allocated on the heap: maxjobs is chosen by the caller */
+static int system_parallel_alloc(struct system_parallel_t *p, int maxjobs) {
+	if (maxjobs <= 0)
+		maxjobs=sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxjobs <= 0)
+		maxjobs=1;
+	p->jobs=malloc(maxjobs * sizeof(*p->jobs));
+	p->pfd=malloc(maxjobs * sizeof(*p->pfd));
+	if (p->jobs == NULL || p->pfd == NULL) {
+		free(p->jobs);
+		free(p->pfd);
+		return errno = ENOMEM, -1;
+	}
+	p->maxjobs=maxjobs;
+	return 0;
+}
+
+static void system_parallel_free(struct system_parallel_t *p) {
+	free(p->jobs);
+	free(p->pfd);
+}
+
+static void system_parallel_done(struct system_parallel_t *p, int index, int status) {
+	if (index < p->nstatus)
+		p->status[index]=status;
+	if (status != 0 && (p->failindex < 0 || index < p->failindex)) {
+		p->failindex=index;
+		p->failstatus=status;
+	}
+}
+
+/* wait for the termination of one of the running jobs */
+static void system_parallel_reap(struct system_parallel_t *p) {
+	struct pollfd *pfd=p->pfd;
+	int i;
+	int status;
+	struct system_parallel_job_t *job=&p->jobs[0];
+	for (i=0; i<p->njobs; i++) {
+		pfd[i].fd=p->jobs[i].pidfd;
+		pfd[i].events=POLLIN;
+		if (pfd[i].fd < 0)
+			break;
+	}
+	/* if pidfds are not available, wait for the oldest job */
+	if (i == p->njobs) {
+		while (poll(pfd, p->njobs, -1) < 0 && errno == EINTR)
+			;
+		for (i=0; i<p->njobs; i++) {
+			if (pfd[i].revents) {
+				job=&p->jobs[i];
+				break;
+			}
+		}
+	}
+	noshell_wait(job->pid, &status);
+	system_parallel_done(p, job->index, status);
+	if (job->pidfd >= 0)
+		close(job->pidfd);
+	p->njobs--;
+	memmove(job, job + 1, (p->jobs + p->njobs - job) * sizeof(*job));
+}
+
+static int system_parallel_f(char **argvv[], void *arg) {
+	struct system_parallel_t *p=arg;
+	struct noshell_child_t c={p->seq.path, NULL, NULL, environ};
+	struct system_parallel_job_t *job;
+	noshell_redir(&c, p->seq.redir);
+	if (p->njobs == p->maxjobs)
+		system_parallel_reap(p);
+	job=&p->jobs[p->njobs];
+	job->index=p->ncmds++;
+	noshell_pipeline(&c, argvv, &job->pid);
+	if (job->pid == -1)
+		system_parallel_done(p, job->index, W_EXITCODE(127, 0));
+	else {
+		job->pidfd=execs_pidfd_open(job->pid);
+		p->njobs++;
+	}
+	return 0;
+}
+
+int _system_parallel(const char *path, const char *command, int redir[3], int flags,
+		int maxjobs, int status[], int nstatus) {
+	if (command) {
+		struct system_parallel_t p={{path, redir, flags}, NULL, 0, 0, 0,
+			status, status ? nstatus : 0, -1, 0};
+		int rv;
+		if (system_parallel_alloc(&p, maxjobs) < 0)
+			return -1;
+		rv = s2multipipe(command, system_parallel_f, &p, flags | EXECS_NOPIPE);
+		while (p.njobs > 0)
+			system_parallel_reap(&p);
+		system_parallel_free(&p);
+		if (rv == -1)
+			return W_EXITCODE(127, 0);
+		return p.failstatus;
+	} else
+		return 1;
+}
+
+/* xargs: the arguments are appended to the command (parsed once) in
+	 batches, as many as the limit of execve(2) allows */
+
+/* room left for the auxiliary vector and alignment (as in xargs) */
+#define XARGS_HEADROOM 2048
+/* minimum size of the batch of arguments */
+#define XARGS_MINARGS 1024
+
+struct system_xargs_t {
+	struct system_parallel_t p;
+	/* source: args or stream (items separated by delim) */
+	char *const *args;
+	FILE *stream;
+	int delim;
+	/* argv of the batch: the command, the arguments, NULL, the redirections
+		 of the command, NULL */
+	char **argv;
+	size_t argvsize;
+	size_t cmdc;
+	char **redir;
+	size_t nredir;
+	size_t argc; // arguments in the batch
+	size_t used; // bytes of the batch
+	size_t budget;
+	size_t maxstrlen;
+	/* copies of the arguments read from stream */
+	char *buf;
+	size_t buflen;
+	int error;
+};
+
+static size_t xargs_size(char *const *argv, size_t n) {
+	size_t size=0;
+	size_t i;
+	for (i=0; i<n; i++)
+		size+=strlen(argv[i]) + 1 + sizeof(char *);
+	return size;
+}
+
+/* run the batch. Spawn failures are reported by the status of the batch */
+static void xargs_flush(struct system_xargs_t *x) {
+	char **argvv[2]={x->argv, NULL};
+	char **end=x->argv + x->cmdc + x->argc;
+	if (x->argc == 0)
+		return;
+	end[0]=NULL;
+	memcpy(end + 1, x->redir, x->nredir * sizeof(char *));
+	end[x->nredir + 1]=NULL;
+	/* the arguments are copied by execve (or by the spawn server):
+		 the buffers can be reused when system_parallel_f returns */
+	system_parallel_f(argvv, &x->p);
+	x->argc=0;
+	x->used=0;
+	x->buflen=0;
+}
+
+/* make room in the batch for an argument of len bytes */
+static int xargs_reserve(struct system_xargs_t *x, size_t len) {
+	size_t cost=len + 1 + sizeof(char *);
+	if (len >= x->maxstrlen || cost > x->budget)
+		return errno = E2BIG, -1;
+	if (x->used + cost > x->budget)
+		xargs_flush(x);
+	if (x->cmdc + x->argc + x->nredir + 3 > x->argvsize) {
+		size_t newsize=2 * x->argvsize;
+		char **newargv=realloc(x->argv, newsize * sizeof(char *));
+		if (newargv == NULL)
+			return -1;
+		x->argv=newargv;
+		x->argvsize=newsize;
+	}
+	x->used+=cost;
+	return 0;
+}
+
+static int xargs_run(struct system_xargs_t *x) {
+	if (x->args) {
+		char *const *arg;
+		for (arg=x->args; *arg; arg++) {
+			if (xargs_reserve(x, strlen(*arg)) < 0)
+				return -1;
+			x->argv[x->cmdc + x->argc++]=*arg;
+		}
+	} else {
+		char *line=NULL;
+		size_t linesize=0;
+		ssize_t len;
+		int rv=0;
+		/* the batch never exceeds the budget: buf does not need to grow */
+		if ((x->buf=malloc(x->budget)) == NULL)
+			return -1;
+		while ((len=getdelim(&line, &linesize, x->delim, x->stream)) > 0) {
+			if (line[len - 1] == x->delim)
+				line[--len]=0;
+			if (xargs_reserve(x, len) < 0) {
+				rv=-1;
+				break;
+			}
+			x->argv[x->cmdc + x->argc++]=memcpy(x->buf + x->buflen, line, len + 1);
+			x->buflen+=len + 1;
+		}
+		if (rv == 0 && ferror(x->stream))
+			rv=-1;
+		free(line);
+		if (rv < 0)
+			return -1;
+	}
+	xargs_flush(x);
+	return 0;
+}
+
+static int system_xargs_f(char **argvv[], void *arg) {
+	struct system_xargs_t *x=arg;
+	char **cmd=argvv[0];
+	long argmax=sysconf(_SC_ARG_MAX);
+	size_t fixed;
+	x->cmdc=s2argc(cmd);
+	x->redir=cmd + x->cmdc + 1;
+	for (x->nredir=0; x->redir[x->nredir]; x->nredir++)
+		;
+	for (fixed=0; environ[fixed]; fixed++)
+		;
+	fixed=xargs_size(environ, fixed) + xargs_size(cmd, x->cmdc) +
+		2 * sizeof(char *) + XARGS_HEADROOM;
+	if (argmax < _POSIX_ARG_MAX)
+		argmax=_POSIX_ARG_MAX;
+	x->budget=((size_t) argmax > fixed) ? argmax - fixed : 0;
+	/* MAX_ARG_STRLEN of linux */
+	x->maxstrlen=32 * sysconf(_SC_PAGESIZE);
+	x->argvsize=x->cmdc + x->nredir + XARGS_MINARGS;
+	if ((x->argv=malloc(x->argvsize * sizeof(char *))) == NULL)
+		x->error=errno;
+	else {
+		memcpy(x->argv, cmd, x->cmdc * sizeof(char *));
+		if (xargs_run(x) < 0)
+			x->error=errno;
+	}
+	free(x->argv);
+	free(x->buf);
+	return 1;
+}
+
+static int system_xargs(struct system_xargs_t *x, const char *command, int flags, int maxjobs) {
+	int rv;
+	if (command == NULL)
+		return 1;
+	if (system_parallel_alloc(&x->p, maxjobs) < 0)
+		return -1;
+	x->p.failindex=-1;
+	rv = s2multipipe(command, system_xargs_f, x, flags | EXECS_NOSEQ | EXECS_NOPIPE);
+	while (x->p.njobs > 0)
+		system_parallel_reap(&x->p);
+	system_parallel_free(&x->p);
+	if (x->error)
+		return errno = x->error, -1;
+	if (rv == -1)
+		return W_EXITCODE(127, 0);
+	return x->p.failstatus;
+}
+
+int _system_xargs(const char *path, const char *command, char *const args[],
+		int redir[3], int flags, int maxjobs) {
+	struct system_xargs_t x={{{path, redir, flags}}, args};
+	if (args == NULL)
+		return errno = EINVAL, -1;
+	return system_xargs(&x, command, flags, maxjobs);
+}
+
+int _system_xargs_stream(const char *path, const char *command, FILE *stream, int delim,
+		int redir[3], int flags, int maxjobs) {
+	struct system_xargs_t x={{{path, redir, flags}}, NULL, stream, delim};
+	if (stream == NULL)
+		return errno = EINVAL, -1;
+	return system_xargs(&x, command, flags, maxjobs);
+}
+
+/* coprocess and async: the command is parsed by the parent,
+	 only the first command of a sequence runs (pipelines are not allowed) */
+struct noshell_spawn1_t {
+	struct noshell_child_t child;
+	pid_t pid;
+};
+
+static int noshell_spawn1_f(char **argvv[], void *arg) {
+	struct noshell_spawn1_t *s=arg;
+	noshell_pipeline(&s->child, argvv, &s->pid);
+	return 1;
+}
+
+static pid_t coprocess_common(const struct execs_ctx *ctx, const char *path,
+		const char *command, char *const argv[], char *const envp[], int pipefd[2], int flags) {
+	if (command || argv) {
 		int pfd_in[2];
 		int pfd_out[2];
-		pid_t pid;
-		if (pipe2(pfd_in, O_CLOEXEC) == -1 || pipe2(pfd_out, O_CLOEXEC) == -1)
+		struct noshell_spawn1_t c={{path, argv ? command : NULL, argv, envp}, -1};
+		c.child.ctx=ctx;
+		if (pipe2(pfd_in, O_CLOEXEC) == -1)
+			return -1;
+		if (pipe2(pfd_out, O_CLOEXEC) == -1) {
+			close(pfd_in[0]);
+			close(pfd_in[1]);
+			return -1;
+		}
+		c.child.fds[0]=pfd_in[0];
+		c.child.fds[1]=pfd_out[1];
+		c.child.fds[2]=-1;
+		if (argv)
+			c.pid=noshell_spawn(&c.child);
+		else if (_s2multipipe_ctx(ctx, command, noshell_spawn1_f, &c, flags | EXECS_NOPIPE) == 0)
+			errno=EINVAL;
+		if (c.pid == -1) {
+			close(pfd_in[0]);
+			close(pfd_in[1]);
+			close(pfd_out[0]);
+			close(pfd_out[1]);
 			return -1;
-		switch (pid=fork()) {
-			case -1:
-				return -1;
-			case 0:
-				if (__builtin_expect(execs_fork_security && execs_fork_security(execs_fork_security_arg) != 0, 0))
-					_exit(127);
-				if (dup2(pfd_in[0],0) == -1 || dup2(pfd_out[1],1) == -1)
-					_exit(127);
-				close(pfd_in[0]);
-				close(pfd_in[1]);
-				close(pfd_out[0]);
-				close(pfd_out[1]);
-				if (argv) {
-					if (path)
-						_execs_common(path, (const char *) argv, envp, NULL, flags);
-					else
-						_execs_common(command, (const char *) argv, envp, NULL, flags);
-				} else
-					_execs_common(path, command, envp, NULL, flags);
-				_exit(127);
-			default:
-				pipefd[0]=pfd_out[0];
-				pipefd[1]=pfd_in[1];
-				close(pfd_in[0]);
-				close(pfd_out[1]);
-				return pid;
 		}
+		pipefd[0]=pfd_out[0];
+		pipefd[1]=pfd_in[1];
+		close(pfd_in[0]);
+		close(pfd_out[1]);
+		return c.pid;
 	} else
 		return 1;
 }
 
+pid_t _coprocess_common(const char *path, const char *command,
+		char *const argv[], char *const envp[], int pipefd[2], int flags) {
+	return coprocess_common(NULL, path, command, argv, envp, pipefd, flags);
+}
+
+pid_t _coprocess_common_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, char *const argv[], int pipefd[2], int flags) {
+	return coprocess_common(ctx, path, command, argv, noshell_envp(ctx), pipefd,
+			ctx ? flags | ctx->flags : flags);
+}
+
+/* popen streams: pids are stored in a table indexed by the file descriptor
+	 of the stream */
 struct popen_info {
 	FILE *stream;
-	pid_t pid;
-	struct popen_info *next;
+	pid_t *pids; // one for each command of the pipeline
+	int npids;
+};
+static struct popen_info *popen_table;
+static int popen_table_size;
+static pthread_mutex_t popen_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+static int popen_table_add(FILE *stream, pid_t *pids, int npids) {
+	int fd=fileno(stream);
+	int rv=0;
+	pthread_mutex_lock(&popen_mutex);
+	if (fd >= popen_table_size) {
+		int newsize=(popen_table_size > 0) ? popen_table_size : 16;
+		struct popen_info *newtable;
+		while (newsize <= fd)
+			newsize*=2;
+		if ((newtable=realloc(popen_table, newsize * sizeof(*newtable))) == NULL) {
+			rv=-1;
+			goto unlock;
+		}
+		memset(newtable + popen_table_size, 0,
+				(newsize - popen_table_size) * sizeof(*newtable));
+		popen_table=newtable;
+		popen_table_size=newsize;
+	}
+	popen_table[fd].stream=stream;
+	popen_table[fd].pids=pids;
+	popen_table[fd].npids=npids;
+unlock:
+	pthread_mutex_unlock(&popen_mutex);
+	return rv;
+}
+
+static pid_t *popen_table_del(FILE *stream, int *npids) {
+	int fd=fileno(stream);
+	pid_t *pids=NULL;
+	pthread_mutex_lock(&popen_mutex);
+	if (fd >= 0 && fd < popen_table_size && popen_table[fd].stream == stream) {
+		pids=popen_table[fd].pids;
+		*npids=popen_table[fd].npids;
+		popen_table[fd].stream=NULL;
+	}
+	pthread_mutex_unlock(&popen_mutex);
+	return pids;
+}
+
+struct popen_spawn_t {
+	struct noshell_child_t child;
+	pid_t *pids;
+	int npids;
 };
-static struct popen_info *popen_list;
+
+static int popen_spawn_f(char **argvv[], void *arg) {
+	struct popen_spawn_t *s=arg;
+	int n;
+	for (n=0; argvv[n]; n++)
+		;
+	if ((s->pids=malloc(n * sizeof(pid_t))) != NULL) {
+		s->npids=n;
+		noshell_pipeline(&s->child, argvv, s->pids);
+	}
+	return 1;
+}
+
+/* spawn the command (or pipeline) of a popen: *pipefd gets the end of the pipe
+	 of the caller. It returns the (malloc-ed) array of the pids, or NULL */
+static pid_t *popen_spawn(const struct execs_ctx *ctx, const char *path, const char *command,
+		int streamno, int flags, int *pipefd, int *npids) {
+	int fd[2];
+	struct popen_spawn_t s={{path, NULL, NULL, noshell_envp(ctx), {-1, -1, -1}}, NULL, 0};
+	if (command == NULL)
+		return errno = EINVAL, NULL;
+	if (pipe2(fd, O_CLOEXEC))
+		return NULL;
+	s.child.ctx=ctx;
+	s.child.fds[1-streamno]=fd[1-streamno];
+	if (_s2multipipe_ctx(ctx, command, popen_spawn_f, &s, flags) == 0)
+		errno = EINVAL;
+	close(fd[1-streamno]);
+	if (s.pids && s.pids[s.npids - 1] == -1) {
+		int saved_errno=errno;
+		close(fd[streamno]);
+		noshell_pipeline_wait(s.pids, s.npids);
+		free(s.pids);
+		errno=saved_errno;
+		return NULL;
+	}
+	if (s.pids == NULL)
+		close(fd[streamno]);
+	else {
+		*pipefd=fd[streamno];
+		*npids=s.npids;
+	}
+	return s.pids;
+}
 
 FILE *_popen_common(const char *path, const char *command, const char *type, int flags) {
+	return _popen_common_ctx(NULL, path, command, type, flags);
+}
+
+FILE *_popen_common_ctx(const struct execs_ctx *ctx,
+		const char *path, const char *command, const char *type, int flags) {
+	if (ctx)
+		flags |= ctx->flags;
 	if ((type[0] == 'r' || type[0] == 'w') && (type[1] == 0 || type[1] == 'e')) {
-		int fd[2];
-		struct popen_info *new;
-		int streamno = (type[0] == 'r') ? STDIN_FILENO : STDOUT_FILENO;
-		if (pipe2(fd, O_CLOEXEC))
+		int fd;
+		FILE *stream;
+		pid_t *pids;
+		int npids;
+		if ((pids=popen_spawn(ctx, path, command, (type[0] == 'r') ? STDIN_FILENO : STDOUT_FILENO,
+						flags, &fd, &npids)) == NULL)
 			return NULL;
-		if ((new=malloc(sizeof(struct popen_info)))==NULL) {
-			errno = ENOMEM;
+		if (type[1] == 'e')
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+		if ((stream = fdopen(fd, type)) == NULL) {
+			close(fd);
+			noshell_pipeline_wait(pids, npids);
+			free(pids);
 			return NULL;
 		}
-		switch (new->pid = fork()) {
-			case -1:
-				close(fd[0]);
-				close(fd[1]);
-				free(new);
-				return NULL;
-			case 0:
-				if (__builtin_expect(execs_fork_security && execs_fork_security(execs_fork_security_arg) != 0, 0))
-					_exit(127);
-				dup2(fd[1-streamno],1-streamno);
-				close(fd[0]);
-				close(fd[1]);
-				if (path)
-					_execs_common(path,(char *) command,environ,(char *) command, flags);
-				else
-					_execs_common(NULL, (char *) command,environ,(char *) command, flags);
-				_exit(127);
-			default:
-				close(fd[1-streamno]);
-				if (type[1] == 'e')
-					fcntl(fd[streamno], F_SETFD, FD_CLOEXEC);
-				if ((new->stream = fdopen(fd[streamno], type)) == NULL) {
-					close(streamno);
-					free(new);
-					return NULL;
-				} else {
-					new->next = popen_list;
-					popen_list = new;
-					return new->stream;
-				}
+		if (popen_table_add(stream, pids, npids) < 0) {
+			fclose(stream);
+			noshell_pipeline_wait(pids, npids);
+			free(pids);
+			errno = ENOMEM;
+			return NULL;
 		}
+		return stream;
 	} else {
 		errno = EINVAL;
 		return NULL;
@@ -171,25 +975,242 @@ FILE *_popen_common(const char *path, const char *command, const char *type, int
 }
 
 int pclose_execs(FILE *stream) {
-	struct popen_info **pprev;
-	for (pprev = &popen_list; *pprev != NULL; pprev = &((*pprev)->next)) {
-		struct popen_info *curr = *pprev;
-		if (curr->stream == stream) {
-			int status;
-			pid_t waitrv;
-			*pprev = curr->next;
-			fclose(curr->stream);
-			while ((waitrv = waitpid(curr->pid, &status, 0)) == -1 && errno == EINTR)
-				;
-			free(curr);
-			if (waitrv != -1)
-				return status;
-			else {
-				errno = ECHILD;
-				return -1;
-			}
+	int npids;
+	pid_t *pids=popen_table_del(stream, &npids);
+	int status;
+	if (pids == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	fclose(stream);
+	status=noshell_pipeline_wait(pids, npids);
+	free(pids);
+	if (status == -1)
+		errno = ECHILD;
+	return status;
+}
+
+/* output capture: the output is read from the pipe straight into the
+	 buffer of the caller (no stdio) */
+
+/* minimum free space in the buffer for each read */
+#define CAPTURE_CHUNK (64 * 1024)
+/* capacity requested for the pipe (it is just a hint) */
+#define CAPTURE_PIPESIZE (1024 * 1024)
+
+struct system_capture_t {
+	struct system_execsq_t seq;
+	struct execs_capture *cap;
+	int error; // errno of the first capture failure, 0 if none
+};
+
+static int capture_grow(struct execs_capture *cap, size_t minfree) {
+	size_t newsize=cap->size ? cap->size : CAPTURE_CHUNK;
+	char *newbuf;
+	while (newsize - cap->len < minfree)
+		newsize*=2;
+	if (newsize == cap->size)
+		return 0;
+	if (cap->flags & EXECS_CAPTURE_MMAP) {
+		/* mremap moves the pages, the data is never copied */
+		if (cap->buf == NULL)
+			newbuf=mmap(NULL, newsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		else
+			newbuf=mremap(cap->buf, cap->size, newsize, MREMAP_MAYMOVE);
+		if (newbuf == MAP_FAILED)
+			return -1;
+	} else if ((newbuf=realloc(cap->buf, newsize)) == NULL)
+		return -1;
+	cap->buf=newbuf;
+	cap->size=newsize;
+	return 0;
+}
+
+/* read until EOF. One byte is always left for the trailing NUL */
+static int capture_drain(struct execs_capture *cap, int fd) {
+	for (;;) {
+		ssize_t n;
+		if (capture_grow(cap, CAPTURE_CHUNK + 1) < 0)
+			return -1;
+		n=read(fd, cap->buf + cap->len, cap->size - cap->len - 1);
+		if (n == 0)
+			return 0;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
 		}
+		cap->len+=n;
+	}
+}
+
+static int system_capture_f(char **argvv[], void *arg) {
+	struct system_capture_t *v=arg;
+	struct noshell_child_t c={v->seq.path, NULL, NULL, noshell_envp(v->seq.ctx), {-1, -1, -1}};
+	int pfd[2];
+	int n;
+	for (n=0; argvv[n]; n++)
+		;
+	pid_t pids[n];
+	c.ctx=v->seq.ctx;
+	if (pipe2(pfd, O_CLOEXEC) < 0) {
+		v->error=errno;
+		return -1;
+	}
+	fcntl(pfd[0], F_SETPIPE_SZ, CAPTURE_PIPESIZE);
+	c.fds[1]=pfd[1];
+	if (v->cap->flags & EXECS_CAPTURE_STDERR)
+		c.fds[2]=pfd[1];
+	noshell_pipeline(&c, argvv, pids);
+	close(pfd[1]);
+	/* on failure the pipe gets closed: the commands get EPIPE and terminate */
+	if (capture_drain(v->cap, pfd[0]) < 0 && v->error == 0)
+		v->error=errno;
+	close(pfd[0]);
+	n=noshell_pipeline_wait(pids, n);
+	return v->error ? -1 : n;
+}
+
+int _system_capture(const char *path, const char *command,
+		struct execs_capture *cap, int flags) {
+	return _system_capture_ctx(NULL, path, command, cap, flags);
+}
+
+int _system_capture_ctx(const struct execs_ctx *ctx, const char *path,
+		const char *command, struct execs_capture *cap, int flags) {
+	struct system_capture_t v={{path, NULL, ctx ? flags | ctx->flags : flags, ctx}, cap, 0};
+	int rv;
+	if (command == NULL || cap == NULL)
+		return errno = EINVAL, -1;
+	/* the buffer is NUL terminated even if there is no output */
+	if (capture_grow(cap, 1) < 0)
+		return -1;
+	rv=_s2multipipe_ctx(ctx, command, system_capture_f, &v, v.seq.flags);
+	cap->buf[cap->len]=0;
+	if (v.error)
+		return errno = v.error, -1;
+	return (rv == -1) ? W_EXITCODE(127, 0) : rv;
+}
+
+void execs_capture_free(struct execs_capture *cap) {
+	if (cap->buf) {
+		if (cap->flags & EXECS_CAPTURE_MMAP)
+			munmap(cap->buf, cap->size);
+		else
+			free(cap->buf);
+	}
+	cap->buf=NULL;
+	cap->len=cap->size=0;
+}
+
+int pclose_execs_deadline(FILE *stream, int timeout) {
+	long long deadline=noshell_deadline(timeout);
+	int npids;
+	pid_t *pids=popen_table_del(stream, &npids);
+	int timedout=0;
+	int status;
+	if (pids == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	fclose(stream);
+	status=noshell_pipeline_wait_deadline(pids, npids, 0, deadline, &timedout);
+	free(pids);
+	if (timedout)
+		return errno = ETIMEDOUT, -1;
+	if (status == -1)
+		errno = ECHILD;
+	return status;
+}
+
+/* asynchronous execution */
+
+/* P_PIDFD of waitid(2), linux >= 5.4 */
+#define NOSHELL_P_PIDFD ((idtype_t) 3)
+
+static int noshell_async_pidfd(pid_t pid, pid_t *ppid) {
+	int pidfd;
+	if (pid == -1)
+		return -1;
+	if ((pidfd=execs_pidfd_open(pid)) < 0) {
+		int saved_errno=errno;
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		errno=saved_errno;
+		return -1;
+	}
+	if (ppid)
+		*ppid=pid;
+	return pidfd;
+}
+
+int _system_async(const char *path, const char *command, int redir[3], int flags, pid_t *pid) {
+	struct noshell_spawn1_t c={{path, NULL, NULL, environ}, -1};
+	noshell_redir(&c.child, redir);
+	if (command == NULL)
+		return errno = EINVAL, -1;
+	if (s2multipipe(command, noshell_spawn1_f, &c, flags | EXECS_NOSEQ | EXECS_NOPIPE) == 0)
+		errno = EINVAL;
+	return noshell_async_pidfd(c.pid, pid);
+}
+
+int _popen_async(const char *path, const char *command, const char *type, int *pipefd,
+		int flags, pid_t *pid) {
+	if ((type[0] == 'r' || type[0] == 'w') && (type[1] == 0 || type[1] == 'e')) {
+		int fd;
+		int pidfd;
+		int npids;
+		pid_t *pids=popen_spawn(NULL, path, command, (type[0] == 'r') ? STDIN_FILENO : STDOUT_FILENO,
+				flags | EXECS_NOSEQ | EXECS_NOPIPE, &fd, &npids);
+		pid_t child;
+		if (pids == NULL)
+			return -1;
+		child=pids[0];
+		free(pids);
+		if ((pidfd=noshell_async_pidfd(child, pid)) < 0)
+			close(fd);
+		else
+			*pipefd=fd;
+		return pidfd;
+	} else
+		return errno = EINVAL, -1;
+}
+
+int _coprocess_async(const char *path, const char *command,
+		char *const argv[], char *const envp[], int pipefd[2], int flags, pid_t *pid) {
+	int pfd[2];
+	int pidfd;
+	pid_t child;
+	if (command == NULL && argv == NULL)
+		return errno = EINVAL, -1;
+	if ((child=_coprocess_common(path, command, argv, envp, pfd, flags)) == -1)
+		return -1;
+	if ((pidfd=noshell_async_pidfd(child, pid)) < 0) {
+		close(pfd[0]);
+		close(pfd[1]);
+	} else {
+		pipefd[0]=pfd[0];
+		pipefd[1]=pfd[1];
+	}
+	return pidfd;
+}
+
+int execs_async_wait(int pidfd, int options) {
+	siginfo_t info;
+	info.si_pid=0;
+	while (waitid(NOSHELL_P_PIDFD, pidfd, &info, WEXITED | (options & WNOHANG)) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	if (info.si_pid == 0)
+		return errno = EAGAIN, -1;
+	close(pidfd);
+	switch (info.si_code) {
+		case CLD_EXITED:
+			return W_EXITCODE(info.si_status, 0);
+		case CLD_DUMPED:
+			return info.si_status | WCOREFLAG;
+		default:
+			return info.si_status;
 	}
-	errno = EINVAL;
-	return -1;
 }
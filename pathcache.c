@@ -0,0 +1,157 @@
+/*
+ * pathcache: cache of the executable files found along $PATH
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <execs.h>
+
+/* the cache is direct mapped: a new entry replaces the one in its bucket */
+#define PATHCACHE_SIZE 64
+/* search path used when $PATH is not defined (as in execvp) */
+#define PATHCACHE_DEFAULT_PATH "/bin:/usr/bin"
+
+struct pathcache_entry {
+	char *file;
+	char *fullpath;
+	int fd; /* O_PATH */
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+};
+
+static struct pathcache_entry pathcache[PATHCACHE_SIZE];
+/* all the entries have been found using this value of $PATH */
+static char *pathcache_path;
+static pthread_mutex_t pathcache_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int pathcache_hash(const char *s) {
+	unsigned int hash=2166136261u;
+	for (; *s; s++)
+		hash=(hash ^ (unsigned char) *s) * 16777619u;
+	return hash % PATHCACHE_SIZE;
+}
+
+static void pathcache_drop(struct pathcache_entry *e) {
+	if (e->file) {
+		close(e->fd);
+		free(e->file);
+		free(e->fullpath);
+		e->file=NULL;
+	}
+}
+
+static void pathcache_flush(void) {
+	int i;
+	for (i=0; i<PATHCACHE_SIZE; i++)
+		pathcache_drop(&pathcache[i]);
+	free(pathcache_path);
+	pathcache_path=NULL;
+}
+
+static int pathcache_valid(struct pathcache_entry *e) {
+	struct stat st;
+	return stat(e->fullpath, &st) == 0 &&
+		st.st_dev == e->dev && st.st_ino == e->ino &&
+		st.st_mtim.tv_sec == e->mtime.tv_sec && st.st_mtim.tv_nsec == e->mtime.tv_nsec;
+}
+
+/* search file along path, store the result in e */
+static int pathcache_search(struct pathcache_entry *e, const char *file, const char *path) {
+	size_t filelen=strlen(file);
+	const char *dir;
+	const char *next;
+	for (dir=path; dir != NULL; dir=next) {
+		size_t dirlen;
+		struct stat st;
+		int fd;
+		next=strchr(dir, ':');
+		dirlen=(next) ? (size_t) (next - dir) : strlen(dir);
+		if (next) next++;
+		/* an empty element means the current directory */
+		char fullpath[dirlen + filelen + 3];
+		if (dirlen == 0)
+			snprintf(fullpath, sizeof(fullpath), "./%s", file);
+		else
+			snprintf(fullpath, sizeof(fullpath), "%.*s/%s", (int) dirlen, dir, file);
+		if ((fd=open(fullpath, O_PATH | O_CLOEXEC)) < 0)
+			continue;
+		if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || access(fullpath, X_OK) < 0) {
+			close(fd);
+			continue;
+		}
+		pathcache_drop(e);
+		if ((e->file=strdup(file)) == NULL || (e->fullpath=strdup(fullpath)) == NULL) {
+			free(e->file);
+			e->file=NULL;
+			close(fd);
+			return -1;
+		}
+		e->fd=fd;
+		e->dev=st.st_dev;
+		e->ino=st.st_ino;
+		e->mtime=st.st_mtim;
+		return 0;
+	}
+	return -1;
+}
+
+int _execs_path_lookup(const char *file, int nowait) {
+	const char *path;
+	struct pathcache_entry *e;
+	int fd=-1;
+	if (file == NULL || *file == 0 || strchr(file, '/') != NULL)
+		return -1;
+	if (nowait) {
+		if (pthread_mutex_trylock(&pathcache_mutex) != 0)
+			return -1;
+	} else
+		pthread_mutex_lock(&pathcache_mutex);
+	if ((path=getenv("PATH")) == NULL)
+		path=PATHCACHE_DEFAULT_PATH;
+	if (pathcache_path == NULL || strcmp(pathcache_path, path) != 0) {
+		pathcache_flush();
+		if ((pathcache_path=strdup(path)) == NULL)
+			goto unlock;
+	}
+	e=&pathcache[pathcache_hash(file)];
+	if (e->file && strcmp(e->file, file) == 0 && !pathcache_valid(e))
+		pathcache_drop(e);
+	if (e->file == NULL || strcmp(e->file, file) != 0) {
+		if (pathcache_search(e, file, path) < 0)
+			goto unlock;
+	}
+	/* the caller gets its own descriptor: the cache can be flushed meanwhile */
+	fd=fcntl(e->fd, F_DUPFD_CLOEXEC, 0);
+unlock:
+	pthread_mutex_unlock(&pathcache_mutex);
+	return fd;
+}
+
+void execs_path_flush(void) {
+	pthread_mutex_lock(&pathcache_mutex);
+	pathcache_flush();
+	pthread_mutex_unlock(&pathcache_mutex);
+}
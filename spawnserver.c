@@ -0,0 +1,392 @@
+/*
+ * spawnserver: create processes on behalf of a (large) process
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <execs.h>
+
+/* The spawn server is a child of the client process, forked when the
+	 client is still small. The server creates the processes by clone(2)
+	 with CLONE_PARENT: the new processes are children of the client, which
+	 waits for them (and gets their exit status) as usual. */
+
+#define SRV_PATH 0x1 /* path is defined */
+#define SRV_FILE 0x2 /* file is defined */
+#define SRV_PATHFD 0x4 /* pathfd has been sent */
+#define SRV_STDFD(i) (0x10 << (i)) /* descriptor i of the child has been sent */
+
+/* descriptors sent with each request: cwd, pathfd (if SRV_PATHFD) and
+	 the descriptors 0, 1, 2 of the child (those which are open) */
+#define SRV_CWD 0
+#define SRV_MAXFDS 5
+
+struct execs_server_req {
+	size_t datalen; /* path, file, argv and envp strings */
+	int argc;
+	int envc;
+	int flags;
+};
+
+struct execs_server_reply {
+	pid_t pid;
+	int err;
+};
+
+static int execs_server_fd=-1;
+static pid_t execs_server_pid=-1;
+/* the server creates children of its client only: the process which started it */
+static pid_t execs_server_owner=-1;
+static pthread_mutex_t execs_server_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t execs_server_once=PTHREAD_ONCE_INIT;
+/* execs_server_start forks the server holding execs_server_mutex */
+static __thread int execs_server_forking;
+
+static int read_all(int fd, void *buf, size_t len) {
+	char *s=buf;
+	while (len > 0) {
+		ssize_t n=read(fd, s, len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		s+=n;
+		len-=n;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+	const char *s=buf;
+	while (len > 0) {
+		ssize_t n=send(fd, s, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		s+=n;
+		len-=n;
+	}
+	return 0;
+}
+
+/* server side */
+
+static void execs_server_child(struct execs_server_req *req, char *path, char *file,
+		char **argv, char **envp, int *fds, int nfds) {
+	int pathfd=-1;
+	int stdfds[3];
+	int next=SRV_CWD + 1;
+	int i;
+	if (nfds < 1 || fchdir(fds[SRV_CWD]) < 0)
+		_exit(127);
+	if (req->flags & SRV_PATHFD)
+		pathfd=fds[next++];
+	for (i=0; i<3; i++) {
+		if (req->flags & SRV_STDFD(i)) {
+			if (next >= nfds)
+				_exit(127);
+			stdfds[i]=fds[next++];
+		} else {
+			/* it is closed in the client */
+			stdfds[i]=-1;
+			close(i);
+		}
+	}
+	signal(SIGPIPE, SIG_DFL);
+	if (__builtin_expect(execs_fork_security && execs_fork_security(execs_fork_security_arg) != 0, 0))
+		_exit(127);
+	_execs_child_exec(path, file, argv, envp, stdfds, pathfd);
+	_exit(127);
+}
+
+static int execs_server_request(int sock) {
+	struct execs_server_req req;
+	struct execs_server_reply reply={-1, 0};
+	char cmsgbuf[CMSG_SPACE(SRV_MAXFDS * sizeof(int))];
+	struct iovec iov={&req, sizeof(req)};
+	struct msghdr msg={.msg_iov=&iov, .msg_iovlen=1,
+		.msg_control=cmsgbuf, .msg_controllen=sizeof(cmsgbuf)};
+	struct cmsghdr *cmsg;
+	int fds[SRV_MAXFDS];
+	int nfds=0;
+	char *data=NULL;
+	char **argv=NULL;
+	ssize_t n;
+	int i;
+	while ((n=recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL)) < 0 && errno == EINTR)
+		;
+	if (n != sizeof(req))
+		return -1;
+	for (cmsg=CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg=CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			nfds=(cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		}
+	}
+	if ((data=malloc(req.datalen)) == NULL ||
+			(argv=malloc((req.argc + req.envc + 2) * sizeof(char *))) == NULL) {
+		reply.err=ENOMEM;
+		/* the request must be consumed anyway */
+		while (req.datalen > 0) {
+			char buf[4096];
+			size_t len=(req.datalen < sizeof(buf)) ? req.datalen : sizeof(buf);
+			if (read_all(sock, buf, len) < 0)
+				return -1;
+			req.datalen-=len;
+		}
+	} else if (read_all(sock, data, req.datalen) < 0)
+		return -1;
+	else {
+		char *scan=data;
+		char *path=NULL;
+		char *file=NULL;
+		char **envp=argv + req.argc + 1;
+		if (req.flags & SRV_PATH)
+			path=scan, scan+=strlen(scan) + 1;
+		if (req.flags & SRV_FILE)
+			file=scan, scan+=strlen(scan) + 1;
+		for (i=0; i<req.argc; i++)
+			argv[i]=scan, scan+=strlen(scan) + 1;
+		argv[i]=NULL;
+		for (i=0; i<req.envc; i++)
+			envp[i]=scan, scan+=strlen(scan) + 1;
+		envp[i]=NULL;
+		/* this process is single threaded: a plain clone syscall is a fork */
+		switch (reply.pid=syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL)) {
+			case -1:
+				reply.err=errno;
+				break;
+			case 0:
+				execs_server_child(&req, path, file, argv, envp, fds, nfds);
+		}
+	}
+	for (i=0; i<nfds; i++)
+		close(fds[i]);
+	free(argv);
+	free(data);
+	return write_all(sock, &reply, sizeof(reply));
+}
+
+/* the server terminates when its socket gets closed by the client:
+	 execs_server_stop, exec or termination of the client (the socket is
+	 close-on-exec and the children of the client close it at fork).
+	 No parent death signal: it would be sent at the termination of the
+	 thread which started the server */
+static void execs_server_main(int sock) {
+	int fd;
+	signal(SIGPIPE, SIG_IGN);
+	/* keep only the standard descriptors and the socket */
+	if (sock != STDERR_FILENO + 1) {
+		dup3(sock, STDERR_FILENO + 1, O_CLOEXEC);
+		close(sock);
+		sock=STDERR_FILENO + 1;
+	}
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, sock + 1, ~0U, 0) < 0)
+#endif
+		for (fd=sock + 1; fd<sysconf(_SC_OPEN_MAX); fd++)
+			close(fd);
+	while (execs_server_request(sock) == 0)
+		;
+	_exit(0);
+}
+
+/* client side */
+
+/* a child created by fork(2) is not a client of the server: it closes its copy
+	 of the socket (the server is not its child) and creates processes by
+	 itself, unless it starts its own server */
+static void execs_server_atfork_prepare(void) {
+	if (!execs_server_forking)
+		pthread_mutex_lock(&execs_server_mutex);
+}
+
+static void execs_server_atfork_parent(void) {
+	if (!execs_server_forking)
+		pthread_mutex_unlock(&execs_server_mutex);
+}
+
+static void execs_server_atfork_child(void) {
+	if (execs_server_fd >= 0) {
+		close(execs_server_fd);
+		execs_server_fd=-1;
+		execs_server_pid=-1;
+		execs_server_owner=-1;
+	}
+	if (!execs_server_forking)
+		pthread_mutex_unlock(&execs_server_mutex);
+}
+
+static void execs_server_atfork(void) {
+	pthread_atfork(execs_server_atfork_prepare, execs_server_atfork_parent,
+			execs_server_atfork_child);
+}
+
+int execs_server_start(void) {
+	int sv[2];
+	pid_t client=getpid();
+	pthread_once(&execs_server_once, execs_server_atfork);
+	pthread_mutex_lock(&execs_server_mutex);
+	if (execs_server_fd >= 0 && execs_server_owner == client)
+		goto done;
+	/* the server of another process (the parent, e.g. fork was not used) */
+	if (execs_server_fd >= 0)
+		return pthread_mutex_unlock(&execs_server_mutex), errno=EBUSY, -1;
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+		goto err;
+	execs_server_forking=1;
+	execs_server_pid=fork();
+	execs_server_forking=0;
+	switch (execs_server_pid) {
+		case -1:
+			close(sv[0]);
+			close(sv[1]);
+			goto err;
+		case 0:
+			close(sv[0]);
+			execs_server_main(sv[1]);
+			break;
+		default:
+			close(sv[1]);
+			execs_server_fd=sv[0];
+			execs_server_owner=client;
+	}
+done:
+	pthread_mutex_unlock(&execs_server_mutex);
+	return 0;
+err:
+	pthread_mutex_unlock(&execs_server_mutex);
+	return -1;
+}
+
+static void execs_server_close(void) {
+	if (execs_server_fd >= 0) {
+		close(execs_server_fd);
+		execs_server_fd=-1;
+		while (waitpid(execs_server_pid, NULL, 0) < 0 && errno == EINTR)
+			;
+		execs_server_pid=-1;
+		execs_server_owner=-1;
+	}
+}
+
+void execs_server_stop(void) {
+	pthread_mutex_lock(&execs_server_mutex);
+	if (execs_server_owner == getpid())
+		execs_server_close();
+	pthread_mutex_unlock(&execs_server_mutex);
+}
+
+static size_t strvlen(char *const v[], int *count) {
+	size_t len=0;
+	int i;
+	for (i=0; v[i] != NULL; i++)
+		len+=strlen(v[i]) + 1;
+	*count=i;
+	return len;
+}
+
+static char *strvcpy(char *dest, char *const v[]) {
+	for (; *v != NULL; v++)
+		dest=stpcpy(dest, *v) + 1;
+	return dest;
+}
+
+pid_t _execs_server_spawn(const char *path, const char *file, char *const argv[],
+		char *const envp[], const int fds[3], int pathfd) {
+	struct execs_server_req req={0, 0, 0, 0};
+	struct execs_server_reply reply;
+	int sendfds[SRV_MAXFDS];
+	char cmsgbuf[CMSG_SPACE(SRV_MAXFDS * sizeof(int))];
+	struct iovec iov={&req, sizeof(req)};
+	struct msghdr msg={.msg_iov=&iov, .msg_iovlen=1, .msg_control=cmsgbuf};
+	struct cmsghdr *cmsg;
+	char *data;
+	char *scan;
+	int nfds=0;
+	int i;
+	if (execs_server_fd < 0 || execs_server_owner != getpid())
+		return errno=ENOTCONN, -1;
+	if (path) {
+		req.flags|=SRV_PATH;
+		req.datalen+=strlen(path) + 1;
+	}
+	if (file) {
+		req.flags|=SRV_FILE;
+		req.datalen+=strlen(file) + 1;
+	}
+	req.datalen+=strvlen(argv, &req.argc) + strvlen(envp, &req.envc);
+	if ((data=malloc(req.datalen)) == NULL)
+		return -1;
+	scan=data;
+	if (path) scan=stpcpy(scan, path) + 1;
+	if (file) scan=stpcpy(scan, file) + 1;
+	scan=strvcpy(scan, argv);
+	strvcpy(scan, envp);
+	if ((sendfds[nfds++]=open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		free(data);
+		return -1;
+	}
+	if (pathfd >= 0) {
+		req.flags|=SRV_PATHFD;
+		sendfds[nfds++]=pathfd;
+	}
+	for (i=0; i<3; i++) {
+		int fd=(fds[i] >= 0) ? fds[i] : i;
+		if (fcntl(fd, F_GETFD) >= 0) {
+			req.flags|=SRV_STDFD(i);
+			sendfds[nfds++]=fd;
+		}
+	}
+	msg.msg_controllen=CMSG_SPACE(nfds * sizeof(int));
+	cmsg=CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level=SOL_SOCKET;
+	cmsg->cmsg_type=SCM_RIGHTS;
+	cmsg->cmsg_len=CMSG_LEN(nfds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), sendfds, nfds * sizeof(int));
+	pthread_mutex_lock(&execs_server_mutex);
+	if (execs_server_fd < 0 || execs_server_owner != getpid()) {
+		errno=ENOTCONN;
+		reply.pid=-1;
+	} else if (sendmsg(execs_server_fd, &msg, MSG_NOSIGNAL) != sizeof(req) ||
+			write_all(execs_server_fd, data, req.datalen) < 0 ||
+			read_all(execs_server_fd, &reply, sizeof(reply)) < 0) {
+		/* the server is not working: the library creates processes by itself */
+		execs_server_close();
+		errno=ENOTCONN;
+		reply.pid=-1;
+	} else if (reply.pid == -1)
+		errno=reply.err;
+	pthread_mutex_unlock(&execs_server_mutex);
+	close(sendfds[SRV_CWD]);
+	free(data);
+	return reply.pid;
+}
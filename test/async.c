@@ -0,0 +1,106 @@
+/*
+ * async: pidfd based asynchronous system, popen and coprocess
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the async functions run one command (sequences and pipelines are
+	 rejected, whatever the flags), the pidfd reports its termination */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+static void test_system(void) {
+	pid_t pid;
+	int pidfd=system_execsp_async("sh -c 'exit 5'", &pid);
+	struct pollfd pfd={pidfd, POLLIN, 0};
+	CHECK(pidfd >= 0 && pid > 0, "system_execsp_async: %s", strerror(errno));
+	CHECK(poll(&pfd, 1, 5000) == 1, "pidfd not readable");
+	CHECK(execs_async_wait(pidfd, 0) == W_EXITCODE(5, 0), "wrong status");
+	pidfd=system_execsp_async("sleep 5", &pid);
+	CHECK(execs_async_wait(pidfd, WNOHANG) == -1 && errno == EAGAIN, "WNOHANG");
+	kill(pid, SIGTERM);
+	CHECK(execs_async_wait(pidfd, 0) == SIGTERM, "killed process status");
+	CHECK(_system_async(NULL, "true; true", NULL, 0, NULL) == -1 && errno == EINVAL,
+			"_system_async runs a sequence");
+}
+
+static void test_popen(void) {
+	int fd;
+	pid_t pid;
+	char buf[64];
+	ssize_t n;
+	int pidfd=popen_execsp_async("echo hello", "r", &fd, &pid);
+	CHECK(pidfd >= 0, "popen_execsp_async: %s", strerror(errno));
+	n=read(fd, buf, sizeof(buf) - 1);
+	CHECK(n == 6 && strncmp(buf, "hello\n", 6) == 0, "popen output");
+	close(fd);
+	CHECK(execs_async_wait(pidfd, 0) == 0, "popen status");
+	/* sequences and pipelines are rejected also when the flags allow them */
+	CHECK(_popen_async(NULL, "echo a; echo b", "r", &fd, 0, NULL) == -1 && errno == EINVAL,
+			"_popen_async runs a sequence");
+	CHECK(_popen_async(NULL, "echo a | cat", "r", &fd, 0, NULL) == -1 && errno == EINVAL,
+			"_popen_async runs a pipeline");
+	CHECK(popen_execsp_async(NULL, "r", &fd, NULL) == -1 && errno == EINVAL,
+			"popen_execsp_async(NULL)");
+	/* no children left behind */
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "stray children");
+}
+
+static void test_coprocess(void) {
+	int pfd[2];
+	char buf[64];
+	ssize_t n;
+	int pidfd=coprocsp_async("cat", pfd, NULL);
+	CHECK(pidfd >= 0, "coprocsp_async: %s", strerror(errno));
+	CHECK(write(pfd[1], "ping\n", 5) == 5, "write");
+	close(pfd[1]);
+	n=read(pfd[0], buf, sizeof(buf) - 1);
+	CHECK(n == 5 && strncmp(buf, "ping\n", 5) == 0, "coprocess output");
+	close(pfd[0]);
+	CHECK(execs_async_wait(pidfd, 0) == 0, "coprocess status");
+}
+
+int main(int argc, char *argv[]) {
+	test_system();
+	test_popen();
+	test_coprocess();
+	if (errors) {
+		fprintf(stderr, "async: %d errors\n", errors);
+		return 1;
+	}
+	printf("async: no errors\n");
+	return 0;
+}
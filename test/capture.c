@@ -0,0 +1,108 @@
+/*
+ * capture: output capture without stdio
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the output is appended to the buffer (malloc or mmap), which is always
+	 NUL terminated, the return value is the wait status. Pipelines and
+	 (for system_nosh_capture) sequences are captured as a whole */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+static int zeros(const char *buf, size_t len) {
+	size_t i;
+	for (i=0; i<len; i++) {
+		if (buf[i] != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void test_capture(int flags) {
+	struct execs_capture cap={NULL, 0, 0, flags};
+	size_t big=3 * 1024 * 1024;
+	CHECK(system_execsp_capture("true", &cap) == 0 && cap.len == 0 && cap.buf && *cap.buf == 0,
+			"no output");
+	CHECK(system_execsp_capture("echo hello", &cap) == 0 && cap.len == 6 &&
+			strcmp(cap.buf, "hello\n") == 0, "echo: \"%s\"", cap.buf);
+	CHECK(system_execsp_capture("echo world", &cap) == 0 &&
+			strcmp(cap.buf, "hello\nworld\n") == 0, "append: \"%s\"", cap.buf);
+	cap.len=0;
+	CHECK(system_execsp_capture("sh -c 'echo x; exit 3'", &cap) == W_EXITCODE(3, 0) &&
+			strcmp(cap.buf, "x\n") == 0, "status: \"%s\"", cap.buf);
+	cap.len=0;
+	CHECK(system_execsp_capture("echo b a | tr ' ' '\\n' | sort", &cap) == 0 &&
+			strcmp(cap.buf, "a\nb\n") == 0, "pipeline: \"%s\"", cap.buf);
+	cap.len=0;
+	CHECK(system_nosh_capture("echo a; echo b", &cap) == 0 &&
+			strcmp(cap.buf, "a\nb\n") == 0, "sequence: \"%s\"", cap.buf);
+	cap.len=0;
+	errno=0;
+	CHECK(system_execsp_capture("echo a; echo b", &cap) == W_EXITCODE(127, 0) && errno == EINVAL,
+			"system_execsp_capture runs a sequence");
+	/* larger than the pipe and than the initial buffer */
+	cap.len=0;
+	CHECK(system_execsp_capture("head -c 3145728 /dev/zero", &cap) == 0 && cap.len == big &&
+			cap.size > big && zeros(cap.buf, big) && cap.buf[big] == 0,
+			"large output: %zu bytes", cap.len);
+	execs_capture_free(&cap);
+	CHECK(cap.buf == NULL && cap.len == 0 && cap.size == 0, "execs_capture_free");
+
+	/* stderr is captured only if requested */
+	cap.flags=flags;
+	CHECK(system_execsp_capture("sh -c 'echo o; echo e >&2' 2>/dev/null", &cap) == 0 &&
+			strcmp(cap.buf, "o\n") == 0, "stdout only: \"%s\"", cap.buf);
+	cap.len=0;
+	cap.flags |= EXECS_CAPTURE_STDERR;
+	CHECK(system_execsp_capture("sh -c 'echo o; echo e >&2'", &cap) == 0 &&
+			strcmp(cap.buf, "o\ne\n") == 0, "stderr: \"%s\"", cap.buf);
+	execs_capture_free(&cap);
+}
+
+int main(int argc, char *argv[]) {
+	struct execs_capture cap={NULL, 0, 0, 0};
+	test_capture(0);
+	test_capture(EXECS_CAPTURE_MMAP);
+	errno=0;
+	CHECK(system_execsp_capture(NULL, &cap) == -1 && errno == EINVAL, "NULL command");
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "stray children");
+	if (errors) {
+		fprintf(stderr, "capture: %d errors\n", errors);
+		return 1;
+	}
+	printf("capture: no errors\n");
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * compiled: compiled commands vs the functions parsing at each call
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* s2multiargv_compiled, s2multipipe_compiled and execs_run_compiled must
+	 give the same results of s2multiargv, s2multipipe and execs on the same
+	 string (|, <, > and & are literal for s2multiargv and execs) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static const char *cases[]={
+	"a b c",
+	"a|b",
+	"x>y",
+	"ls |",
+	"| ls",
+	"a 2>&1 b",
+	"a >> b < c",
+	"cat <in | wc -l >out 2>&1",
+	"echo 'q|w' \"<\" & x",
+	"a;b|c;d",
+	"$CVAR|x $CVAR",
+	"a 12>x",
+	">",
+	"",
+	"  ",
+	NULL
+};
+
+struct out {
+	char buf[1024];
+	size_t len;
+};
+
+static void out_add(struct out *o, const char *s) {
+	o->len += snprintf(o->buf + o->len, sizeof(o->buf) - o->len, "%s", s);
+	if (o->len >= sizeof(o->buf))
+		o->len=sizeof(o->buf) - 1;
+}
+
+static void out_argv(struct out *o, char **argv) {
+	for (; *argv; argv++) {
+		out_add(o, "<");
+		out_add(o, *argv);
+		out_add(o, ">");
+	}
+}
+
+static int multiargv_f(char **argv, void *opaque) {
+	out_argv(opaque, argv);
+	out_add(opaque, ";");
+	return 0;
+}
+
+/* each stage: argv, then its redirections (operator and target pairs) */
+static int multipipe_f(char **argvv[], void *opaque) {
+	for (; *argvv; argvv++) {
+		char **argv=*argvv;
+		out_argv(opaque, argv);
+		while (*argv)
+			argv++;
+		out_add(opaque, " redir:");
+		out_argv(opaque, argv + 1);
+		out_add(opaque, "|");
+	}
+	out_add(opaque, ";");
+	return 0;
+}
+
+static void out_rv(struct out *o, int rv) {
+	char rvs[64];
+	snprintf(rvs, sizeof(rvs), " rv=%d errno=%d", rv, rv < 0 ? errno : 0);
+	out_add(o, rvs);
+}
+
+/* the output of /bin/echo run by execs or execs_run_compiled */
+static void out_exec(struct out *o, const char *args, const struct s2argv_compiled *t) {
+	int pipefd[2];
+	pid_t pid;
+	ssize_t n;
+	int status;
+	if (pipe(pipefd) < 0)
+		exit(2);
+	if ((pid=fork()) == 0) {
+		dup2(pipefd[1], STDOUT_FILENO);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		if (t)
+			execs_run_compiled("/bin/echo", t, environ);
+		else
+			execs("/bin/echo", args);
+		_exit(127);
+	}
+	close(pipefd[1]);
+	while ((n=read(pipefd[0], o->buf + o->len, sizeof(o->buf) - 1 - o->len)) > 0)
+		o->len += n;
+	o->buf[o->len]=0;
+	close(pipefd[0]);
+	waitpid(pid, &status, 0);
+	out_rv(o, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+static int check(const char *what, const char *args, struct out *ref, struct out *new) {
+	if (strcmp(ref->buf, new->buf) == 0)
+		return 0;
+	fprintf(stderr, "%s \"%s\":\n  plain    %s\n  compiled %s\n", what, args, ref->buf, new->buf);
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	const char **args;
+	int errors=0;
+	setenv("CVAR", "v|v", 1);
+	s2argv_getvar=getenv;
+	for (args=cases; *args; args++) {
+		struct s2argv_compiled *t=s2argv_compile(*args, 0);
+		struct out ref={"", 0}, new={"", 0};
+		if (t == NULL) {
+			fprintf(stderr, "s2argv_compile \"%s\": %s\n", *args, strerror(errno));
+			errors++;
+			continue;
+		}
+		out_rv(&ref, s2multiargv(*args, multiargv_f, &ref, 0));
+		out_rv(&new, s2multiargv_compiled(t, multiargv_f, &new));
+		errors += check("s2multiargv", *args, &ref, &new);
+		ref.len=new.len=0;
+		*ref.buf=*new.buf=0;
+		out_rv(&ref, s2multipipe(*args, multipipe_f, &ref, 0));
+		out_rv(&new, s2multipipe_compiled(t, multipipe_f, &new));
+		errors += check("s2multipipe", *args, &ref, &new);
+		s2argv_compiled_free(t);
+		/* execs runs one command (EXECS_NOSEQ) */
+		ref.len=new.len=0;
+		*ref.buf=*new.buf=0;
+		out_exec(&ref, *args, NULL);
+		if ((t=s2argv_compile(*args, EXECS_NOSEQ)) != NULL) {
+			out_exec(&new, *args, t);
+			s2argv_compiled_free(t);
+		} else
+			out_rv(&new, 127);
+		errors += check("execs", *args, &ref, &new);
+	}
+	if (errors) {
+		fprintf(stderr, "compiled: %d errors\n", errors);
+		return 1;
+	}
+	printf("compiled: %zu commands, no differences\n", sizeof(cases) / sizeof(cases[0]) - 1);
+	return 0;
+}
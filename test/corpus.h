@@ -0,0 +1,51 @@
+/*
+ * corpus: random command strings for the parser tests
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+#include <stdlib.h>
+
+/* the strings are built from the chars which matter for the FSA, long runs
+	 exercise the vectorized fast path. The sequence depends on srandom only,
+	 so all the tests using the same seed parse the same strings */
+static const char corpus_alphabet[]=" \t\n'\";$|<>&ab1_2*xyz";
+
+/* s gets a NUL terminated string, shorter than maxlen */
+static void corpus_gen(char *s, size_t maxlen)
+{
+	size_t len=random() % maxlen;
+	size_t i;
+	for (i=0; i<len; i++) {
+		int r=random() % 100;
+		if (r < 3) {
+			/* a long run: the fast path */
+			size_t run=random() % 80;
+			char c=(random() % 2) ? 'x' : ' ';
+			for (; run > 0 && i < len; run--)
+				s[i++]=c;
+			i--;
+		} else if (r < 5)
+			s[i]=1 + random() % 255;
+		else
+			s[i]=corpus_alphabet[random() % (sizeof(corpus_alphabet) - 1)];
+	}
+	s[len]=0;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * deadline: system and pclose with a deadline
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* commands completing in time return their status, the others fail
+	 with ETIMEDOUT soon after the deadline (SIGKILL follows SIGTERM when it is
+	 ignored), the deadline applies to the whole sequence, the commands
+	 are always waited for */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* the commands must terminate with ETIMEDOUT between timeout and timeout + 2s */
+static void check_timeout(int (*run)(const char *cmd, int timeout), const char *cmd, int timeout) {
+	long long start=now_ms();
+	int rv;
+	long long elapsed;
+	errno=0;
+	rv=run(cmd, timeout);
+	elapsed=now_ms() - start;
+	CHECK(rv == -1 && errno == ETIMEDOUT, "\"%s\": rv %x errno %d", cmd, rv, errno);
+	CHECK(elapsed >= timeout && elapsed < timeout + 2000, "\"%s\": %lld ms", cmd, elapsed);
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "\"%s\": stray children", cmd);
+}
+
+static int run_system(const char *cmd, int timeout) {
+	return system_execsp_deadline(cmd, timeout);
+}
+
+static int run_nosh(const char *cmd, int timeout) {
+	return system_nosh_deadline(cmd, timeout);
+}
+
+static int run_popen(const char *cmd, int timeout) {
+	FILE *f=popen_execsp(cmd, "r");
+	if (f == NULL)
+		return -2;
+	return pclose_execs_deadline(f, timeout);
+}
+
+int main(int argc, char *argv[]) {
+	FILE *f;
+	CHECK(system_execsp_deadline("sh -c 'exit 3'", 5000) == W_EXITCODE(3, 0), "in time");
+	CHECK(system_execsp_deadline("true", -1) == 0, "no limit");
+	CHECK(system_nosh_deadline("true; sh -c 'exit 4'", 5000) == W_EXITCODE(4, 0), "sequence in time");
+	check_timeout(run_system, "sleep 10", 200);
+	/* SIGTERM is ignored */
+	check_timeout(run_system, "sh -c 'trap \"\" TERM; while :; do :; done'", 200);
+	/* the process group: all the commands of the pipeline */
+	check_timeout(run_system, "sleep 10 | sleep 10", 200);
+	/* the deadline applies to the whole sequence, not to each command */
+	check_timeout(run_nosh, "sleep 0.2; sleep 0.2; sleep 0.2; sleep 0.2", 500);
+	check_timeout(run_popen, "sleep 10", 200);
+	check_timeout(run_popen, "sleep 10 | sleep 10", 200);
+	/* the output is read: echo does not get SIGPIPE */
+	f=popen_execsp("echo a", "r");
+	CHECK(f != NULL && fgetc(f) == 'a' && pclose_execs_deadline(f, 5000) == 0, "pclose in time");
+	if (errors) {
+		fprintf(stderr, "deadline: %d errors\n", errors);
+		return 1;
+	}
+	printf("deadline: no errors\n");
+	return 0;
+}
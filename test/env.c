@@ -0,0 +1,185 @@
+/*
+ * env: environment overlays
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the envp of an overlay is its base with the variables of the delta set
+	 or unset; the strings of the base are shared, a new value of a
+	 variable already in envp does not rebuild it. The envp is used by
+	 execse, coprocspe and contexts (the programs get exactly that environment) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+/* envp as a string: the definitions separated by spaces */
+static char *envstr(char *const *envp) {
+	static char buf[256];
+	size_t len=0;
+	*buf=0;
+	if (envp == NULL)
+		return "NULL";
+	for (; *envp; envp++)
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%s", len ? " " : "", *envp);
+	return buf;
+}
+
+/* the index of def in envp, -1 if it is not there */
+static int envidx(char *const *envp, const char *def) {
+	int i;
+	for (i=0; envp[i]; i++) {
+		if (strcmp(envp[i], def) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* the output of the program env run by coprocspe */
+static char *coproc_env(char *const *envp) {
+	static char buf[256];
+	int pfd[2];
+	size_t len=0;
+	ssize_t n;
+	pid_t pid=coprocspe("env", envp, pfd);
+	*buf=0;
+	if (pid < 0)
+		return "error";
+	close(pfd[1]);
+	while (len < sizeof(buf) - 1 && (n=read(pfd[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+		len += n;
+	buf[len]=0;
+	close(pfd[0]);
+	waitpid(pid, NULL, 0);
+	return buf;
+}
+
+static void test_overlay(void) {
+	char *base[]={"A=1", "B=2", "C=3", NULL};
+	struct execs_env *env=execs_env_new(base);
+	char *const *envp;
+	CHECK(env != NULL, "execs_env_new: %s", strerror(errno));
+	if (env == NULL)
+		return;
+	envp=execs_env_envp(env);
+	CHECK(strcmp(envstr(envp), "A=1 B=2 C=3") == 0, "base: %s", envstr(envp));
+	execs_env_set(env, "B", "x");
+	execs_env_set(env, "C", NULL);
+	execs_env_set(env, "D", "4");
+	envp=execs_env_envp(env);
+	CHECK(strcmp(envstr(envp), "A=1 B=x D=4") == 0, "delta: %s", envstr(envp));
+	/* shared, not copied */
+	CHECK(envp[envidx(envp, "A=1")] == base[0], "the base is copied");
+	/* a new value: same envp, updated in place */
+	execs_env_set(env, "B", "y");
+	CHECK(execs_env_envp(env) == envp && strcmp(envstr(envp), "A=1 B=y D=4") == 0,
+			"new value: %s", envstr(envp));
+	execs_env_set(env, "C", "back");
+	envp=execs_env_envp(env);
+	CHECK(strcmp(envstr(envp), "A=1 B=y C=back D=4") == 0, "set again: %s", envstr(envp));
+	execs_env_set(env, "D", NULL);
+	envp=execs_env_envp(env);
+	CHECK(strcmp(envstr(envp), "A=1 B=y C=back") == 0, "unset: %s", envstr(envp));
+	errno=0;
+	CHECK(execs_env_set(env, "X=Y", "z") == -1 && errno == EINVAL, "= in the name");
+	CHECK(execs_env_set(env, "", "z") == -1 && errno == EINVAL, "empty name");
+	/* the programs get envp */
+	CHECK(strcmp(coproc_env(envp), "A=1\nB=y\nC=back\n") == 0, "coprocspe: %s", coproc_env(envp));
+	execs_env_reset(env);
+	envp=execs_env_envp(env);
+	CHECK(strcmp(envstr(envp), "A=1 B=2 C=3") == 0, "reset: %s", envstr(envp));
+	execs_env_free(env);
+	execs_env_free(NULL);
+}
+
+/* the base is environ */
+static void test_environ(void) {
+	struct execs_env *env=execs_env_new(NULL);
+	struct execs_capture cap={NULL, 0, 0, 0};
+	struct execs_ctx ctx;
+	char *const *envp;
+	int pipefd[2];
+	char buf[64];
+	ssize_t n;
+	pid_t pid;
+	int status;
+	CHECK(env != NULL, "execs_env_new: %s", strerror(errno));
+	if (env == NULL)
+		return;
+	setenv("ENVTEST", "old", 1);
+	execs_env_set(env, "ENVTEST_NEW", "new");
+	envp=execs_env_envp(env);
+	CHECK(envidx(envp, "ENVTEST=old") >= 0 && envidx(envp, "ENVTEST_NEW=new") >= 0,
+			"environ");
+	/* environ changed in place: the overlay must be flushed */
+	setenv("ENVTEST", "changed", 1);
+	execs_env_flush(env);
+	envp=execs_env_envp(env);
+	CHECK(envidx(envp, "ENVTEST=changed") >= 0, "flush");
+	execs_env_set(env, "ENVTEST", NULL);
+	envp=execs_env_envp(env);
+	CHECK(envidx(envp, "ENVTEST=changed") < 0, "unset a variable of environ");
+	/* execse */
+	if (pipe(pipefd) < 0)
+		return;
+	if ((pid=fork()) == 0) {
+		dup2(pipefd[1], STDOUT_FILENO);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		execse("/bin/sh", "sh -c 'echo ${ENVTEST-unset} $ENVTEST_NEW'", envp);
+		_exit(127);
+	}
+	close(pipefd[1]);
+	n=read(pipefd[0], buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0]=0;
+	close(pipefd[0]);
+	CHECK(waitpid(pid, &status, 0) == pid && status == 0 && strcmp(buf, "unset new\n") == 0,
+			"execse: \"%s\"", buf);
+	/* contexts */
+	execs_ctx_init(&ctx);
+	ctx.envp=envp;
+	CHECK(_system_capture_ctx(&ctx, NULL, "sh -c 'echo ${ENVTEST-unset} $ENVTEST_NEW'", &cap,
+				EXECS_NOSEQ) == 0 && strcmp(cap.buf, "unset new\n") == 0, "context: \"%s\"", cap.buf);
+	execs_capture_free(&cap);
+	execs_env_free(env);
+}
+
+int main(int argc, char *argv[]) {
+	test_overlay();
+	test_environ();
+	if (errors) {
+		fprintf(stderr, "env: %d errors\n", errors);
+		return 1;
+	}
+	printf("env: no errors\n");
+	return 0;
+}
@@ -0,0 +1,389 @@
+/*
+ * fsadiff: differential test of the command parser
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* s2argv, s2multiargv and s2multiargv_mem must give the same results
+	 of the original (switch based, one char at a time) FSA, which is
+	 copied here as the reference, on random command strings (see corpus.h).
+	 s2multipipe is checked on a table of cases.
+	 Usage: fsadiff [iterations [seed]] */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <execs.h>
+#include "corpus.h"
+
+#define END 0
+#define SPACE 1
+#define CHAR 2
+#define SGLQ 3
+#define DBLQ 4
+#define ESCAPE 5
+#define SEMIC 6
+#define VAR 7
+#define ESCVAR 8
+#define DBLESC 9
+#define NSTATES (DBLESC+1)
+
+#define NEWARG 0x1
+#define CHCOPY 0x2
+#define ENDARG 0x4
+#define ENDVAR 0x8
+#define ENDCMD 0x10
+
+static char nextstate[NSTATES][NSTATES-1]= {
+	{END,    0,   0,   0,   0,     0,    0,   0}, // END
+	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR}, // SPACE
+	{END,SPACE,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC,CHAR}, // CHAR
+	{END, SGLQ,SGLQ,CHAR,SGLQ,  SGLQ, SGLQ,SGLQ}, // SGLQ
+	{END, DBLQ,DBLQ,DBLQ,CHAR,DBLESC, DBLQ,DBLQ}, // DBLQ
+	{END, CHAR,CHAR,CHAR,CHAR,  CHAR, CHAR,CHAR}, // ESCAPE
+	{END,SEMIC,CHAR,SGLQ,DBLQ,ESCAPE,SEMIC, VAR}, // SEMIC
+	{END,SPACE, VAR, VAR, VAR,   VAR,SEMIC, VAR}, // VAR
+	{END,  VAR, VAR, VAR, VAR,   VAR,  VAR, VAR}, // ESCVAR
+	{END, DBLQ,DBLQ,DBLQ,DBLQ,  DBLQ, DBLQ,DBLQ}}; // DBLESC
+
+static char action[NSTATES][NSTATES-1]= {
+	{ENDCMD|     0,     0,            0,     0,     0,     0,            0,     0}, //END
+	{ENDCMD|     0,     0,NEWARG|CHCOPY,NEWARG,NEWARG,NEWARG,       ENDCMD,NEWARG}, //SPACE
+	{ENDCMD|ENDARG,ENDARG,       CHCOPY,     0,     0,     0,ENDCMD|ENDARG,     0}, //CHAR
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,     0,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //SNGQ
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,     0,CHCOPY,       CHCOPY,CHCOPY}, //DBLQ
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //ESCAPE
+	{ENDCMD|     0,     0,NEWARG|CHCOPY,NEWARG,NEWARG,NEWARG,            0,NEWARG}, //SEMIC
+	{ENDCMD|ENDVAR,ENDVAR,       CHCOPY,     0,     0,     0,ENDCMD|ENDVAR,     0}, //VAR
+	{ENDCMD|ENDVAR,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}, //ESCVAR
+	{ENDCMD|ENDARG,CHCOPY,       CHCOPY,CHCOPY,CHCOPY,CHCOPY,       CHCOPY,CHCOPY}}; //DBLESC
+
+static int ref_args_fsa(const char *args, char **argv, char *buf, int flags)
+{
+	int state=SPACE;
+	int argc=0;
+	char *thisarg=NULL;
+	for (;state != END;args++) {
+		int this;
+		switch (*args) {
+			case 0: this=END; break;
+			case ' ': case '\t': case '\n': this=SPACE; break;
+			case '\'': this=SGLQ; break;
+			case '"': this=DBLQ; break;
+			case '\\': this=ESCAPE; break;
+			case ';': this=SEMIC; break;
+			case '$': this=VAR; break;
+			default: this=CHAR;
+		}
+		if (argv) {
+			if (action[state][this] & NEWARG)
+				thisarg=buf;
+			if (action[state][this] & CHCOPY)
+				*buf++=*args;
+			if (action[state][this] & ENDARG) {
+				*buf++=0;
+				*argv++=thisarg;
+			}
+			if (action[state][this] & ENDVAR) {
+				*buf++=0;
+				if (s2argv_getvar) {
+					*argv=s2argv_getvar(thisarg);
+					if (*argv == NULL)
+						*argv="";
+				} else
+					*argv="";
+				argv++;
+			}
+			if (action[state][this] & ENDCMD)
+				*argv++=0;
+		}
+		if (action[state][this] & (ENDARG|ENDVAR))
+			argc++;
+		if (action[state][this] & ENDCMD)
+			argc++;
+		state=nextstate[state][this];
+		switch (state) {
+			case VAR: if (flags & EXECS_NOVAR) return errno = EINVAL, -1;
+									break;
+			case SEMIC: if (flags & EXECS_NOSEQ) return errno = EINVAL, -1;
+										break;
+		}
+	}
+	if (argv)
+		*argv=0;
+	return argc;
+}
+
+/* results are compared as strings: "<arg>" for each argument, "|" at the
+	 end of each command */
+struct out {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static void out_add(struct out *o, const char *s, size_t len)
+{
+	if (o->len + len + 1 > o->size) {
+		while (o->len + len + 1 > o->size)
+			o->size=o->size ? 2 * o->size : 4096;
+		if ((o->buf=realloc(o->buf, o->size)) == NULL)
+			abort();
+	}
+	memcpy(o->buf + o->len, s, len);
+	o->len+=len;
+	o->buf[o->len]=0;
+}
+
+static void out_argv(struct out *o, char **argv)
+{
+	for (; *argv; argv++) {
+		out_add(o, "<", 1);
+		out_add(o, *argv, strlen(*argv));
+		out_add(o, ">", 1);
+	}
+	out_add(o, "|", 1);
+}
+
+static int out_f(char **argv, void *arg)
+{
+	out_argv(arg, argv);
+	return 0;
+}
+
+/* the reference s2argv: all the commands */
+static void ref_s2argv(const char *args, struct out *o)
+{
+	int argc=ref_args_fsa(args, NULL, NULL, 0);
+	char *argv[argc+1];
+	char buf[strlen(args)+1];
+	char **scan;
+	ref_args_fsa(args, argv, buf, 0);
+	for (scan=argv; *scan; scan++) {
+		out_argv(o, scan);
+		while (*scan) scan++;
+	}
+}
+
+/* the reference s2multiargv: it stops at the first empty command.
+	 skipempty: the commands of the streaming variants, empty ones are skipped */
+static int ref_s2multiargv(const char *args, struct out *o, int flags, int skipempty)
+{
+	int argc=ref_args_fsa(args, NULL, NULL, flags);
+	if (argc < 0)
+		return -1;
+	char *argv[argc+1];
+	char buf[strlen(args)+1];
+	char **scan=argv;
+	ref_args_fsa(args, argv, buf, 0);
+	while (scan - argv < argc) {
+		if (*scan == NULL && !skipempty)
+			break;
+		if (*scan)
+			out_argv(o, scan);
+		while (*scan) scan++;
+		scan++;
+	}
+	return 0;
+}
+
+/* the values must stay valid while a command is parsed (as for getenv):
+	 there can be at most one variable every two chars of input */
+#define NVALUES 512
+static char *getvar(const char *name)
+{
+	static char values[NVALUES][64];
+	static int next;
+	char *value=values[next++ % NVALUES];
+	/* undefined variables, empty and non empty values */
+	if (*name == 'a')
+		return NULL;
+	if (*name == 'b')
+		return "";
+	snprintf(value, sizeof(values[0]), "=%s=", name);
+	return value;
+}
+
+/* s2multipipe has no reference: table driven cases for pipelines and
+	 redirections. Each stage is <arg>... {op}{target}... followed by |,
+	 each pipeline by ; (out is NULL: EINVAL) */
+static const struct {
+	const char *args;
+	int flags;
+	const char *out;
+} pipecases[]={
+	{"a | b", 0, "<a>|<b>|;"},
+	{"a|b|c", 0, "<a>|<b>|<c>|;"},
+	{"a | b; c", 0, "<a>|<b>|;<c>|;"},
+	{"a>b", 0, "<a>{>}{b}|;"},
+	{"a > b", 0, "<a>{>}{b}|;"},
+	{"a >>b", 0, "<a>{>>}{b}|;"},
+	{"a 1>>x", 0, "<a>{1>>}{x}|;"},
+	{"a 2>&1", 0, "<a>{2>&}{1}|;"},
+	{"a >&2", 0, "<a>{>&}{2}|;"},
+	{"a <&0", 0, "<a>{<&}{0}|;"},
+	{"a >& b", 0, "<a>{>&}{b}|;"},
+	{"a <in >out", 0, "<a>{<}{in}{>}{out}|;"},
+	{"a 0<in", 0, "<a>{0<}{in}|;"},
+	{"< in cat", 0, "<cat>{<}{in}|;"},
+	{"a b>c d", 0, "<a><b><d>{>}{c}|;"},
+	{"a > b > c", 0, "<a>{>}{b}{>}{c}|;"},
+	{"a 2>&1 | b 2>&1", 0, "<a>{2>&}{1}|<b>{2>&}{1}|;"},
+	{"a >b;c", 0, "<a>{>}{b}|;<c>|;"},
+	/* a digit is a descriptor only if it is a word of its own */
+	{"x2>y", 0, "<x2>{>}{y}|;"},
+	{"'2'>y", 0, "<2>{>}{y}|;"},
+	/* quoted or escaped operators, & alone */
+	{"\"a|b\" 'c>d' e\\|f", 0, "<a|b><c>d><e|f>|;"},
+	{"a & b", 0, "<a><&><b>|;"},
+	{"a;;b", 0, "<a>|;<b>|;"},
+	{"a|b", EXECS_NOREDIR, "<a>|<b>|;"},
+	{"a>b", EXECS_NOPIPE, "<a>{>}{b}|;"},
+	/* syntax errors */
+	{"a 3>x", 0, NULL},
+	{"a 12>x", 0, NULL},
+	{"a >", 0, NULL},
+	{"a >&", 0, NULL},
+	{"a > |", 0, NULL},
+	{"a >>> b", 0, NULL},
+	{"a <> b", 0, NULL},
+	{">out", 0, NULL},
+	{"a | | b", 0, NULL},
+	{"| a", 0, NULL},
+	{"a |", 0, NULL},
+	{"a ; | b", 0, NULL},
+	{"a|;b", 0, NULL},
+	/* restrictions */
+	{"a|b", EXECS_NOPIPE, NULL},
+	{"a>b", EXECS_NOREDIR, NULL},
+	{"a 2>&1", EXECS_NOREDIR, NULL},
+	{"a|b;c", EXECS_NOSEQ, NULL},
+};
+
+static int out_pipe_f(char **argvv[], void *arg)
+{
+	for (; *argvv; argvv++) {
+		char **argv=*argvv;
+		for (; *argv; argv++) {
+			out_add(arg, "<", 1);
+			out_add(arg, *argv, strlen(*argv));
+			out_add(arg, ">", 1);
+		}
+		for (argv++; *argv; argv++) {
+			out_add(arg, "{", 1);
+			out_add(arg, *argv, strlen(*argv));
+			out_add(arg, "}", 1);
+		}
+		out_add(arg, "|", 1);
+	}
+	out_add(arg, ";", 1);
+	return 0;
+}
+
+static int check_pipecases(void)
+{
+	struct out o={NULL, 0, 0};
+	size_t i;
+	int errors=0;
+	for (i=0; i<sizeof(pipecases) / sizeof(pipecases[0]); i++) {
+		int rv;
+		o.len=0;
+		out_add(&o, "", 0);
+		errno=0;
+		rv=s2multipipe(pipecases[i].args, out_pipe_f, &o, pipecases[i].flags);
+		if (pipecases[i].out == NULL ? rv != -1 || errno != EINVAL :
+				rv != 0 || strcmp(o.buf, pipecases[i].out) != 0) {
+			fprintf(stderr, "s2multipipe(%x): \"%s\"\n  expected: %s\n  got: %s (rv %d)\n",
+					pipecases[i].flags, pipecases[i].args,
+					pipecases[i].out ? pipecases[i].out : "EINVAL", o.buf, rv);
+			errors++;
+		}
+	}
+	free(o.buf);
+	return errors;
+}
+
+static int check(const char *what, int flags, const char *args, struct out *ref, struct out *new)
+{
+	if (ref->len == new->len && memcmp(ref->buf, new->buf, ref->len) == 0)
+		return 0;
+	fprintf(stderr, "%s(%x): mismatch\n  input: \"%s\"\n  ref: %.*s\n  new: %.*s\n",
+			what, flags, args, (int) ref->len, ref->buf ? ref->buf : "",
+			(int) new->len, new->buf ? new->buf : "");
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations=(argc > 1) ? atol(argv[1]) : 200000;
+	unsigned int seed=(argc > 2) ? atoi(argv[2]) : 42;
+	static const int flagset[]={0, EXECS_NOVAR, EXECS_NOSEQ, EXECS_NOSEQ | EXECS_NOVAR};
+	struct out ref={NULL, 0, 0};
+	struct out new={NULL, 0, 0};
+	char args[512];
+	long i;
+	int j;
+	int errors=0;
+	errors+=check_pipecases();
+	srandom(seed);
+	s2argv_getvar=getvar;
+	for (i=0; i<iterations && errors < 10; i++) {
+		char **nargv;
+		corpus_gen(args, (i % 16 == 0) ? sizeof(args) : 48);
+		ref.len=new.len=0;
+		ref_s2argv(args, &ref);
+		if ((nargv=s2argv(args)) == NULL)
+			return perror("s2argv"), 1;
+		for (char **scan=nargv; *scan; scan++) {
+			out_argv(&new, scan);
+			while (*scan) scan++;
+		}
+		s2argv_free(nargv);
+		errors+=check("s2argv", 0, args, &ref, &new);
+		for (j=0; j<4; j++) {
+			int flags=flagset[j];
+			int refrv;
+			int newrv;
+			ref.len=new.len=0;
+			refrv=ref_s2multiargv(args, &ref, flags, 0);
+			newrv=s2multiargv(args, out_f, &new, flags);
+			if (refrv != newrv) {
+				fprintf(stderr, "s2multiargv(%x): rv %d != %d\n  input: \"%s\"\n", flags, newrv, refrv, args);
+				errors++;
+			} else
+				errors+=check("s2multiargv", flags, args, &ref, &new);
+			if (flags & EXECS_NOSEQ)
+				continue;
+			ref.len=new.len=0;
+			refrv=ref_s2multiargv(args, &ref, flags, 1);
+			newrv=s2multiargv_mem(args, strlen(args), out_f, &new, flags);
+			/* in case of error the commands already read have been parsed */
+			if (refrv != newrv) {
+				fprintf(stderr, "s2multiargv_mem(%x): rv %d != %d\n  input: \"%s\"\n", flags, newrv, refrv, args);
+				errors++;
+			} else if (refrv == 0)
+				errors+=check("s2multiargv_mem", flags, args, &ref, &new);
+		}
+	}
+	free(ref.buf);
+	free(new.buf);
+	if (errors)
+		return 1;
+	printf("fsadiff: %ld inputs, no differences\n", i);
+	return 0;
+}
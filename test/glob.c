@@ -0,0 +1,206 @@
+/*
+ * glob: pathname expansion and its directory cache
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* _execs_glob and EXECS_GLOB on a tree of files in a temporary directory:
+	 sorted matches, hidden files, patterns in several components, quoted
+	 patterns, values of variables and redirection targets are not expanded.
+	 The listing of a directory is cached while its mtime does not change
+	 (the test restores an old mtime to see the cached listing) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+struct out {
+	char buf[1024];
+	size_t len;
+};
+
+static void out_add(struct out *o, const char *s) {
+	o->len += snprintf(o->buf + o->len, sizeof(o->buf) - o->len, "%s", s);
+	if (o->len >= sizeof(o->buf))
+		o->len=sizeof(o->buf) - 1;
+}
+
+/* <arg> for each match or argument, redirections as {op}{target} */
+static void out_argv(struct out *o, char **argv) {
+	for (; *argv; argv++) {
+		out_add(o, "<");
+		out_add(o, *argv);
+		out_add(o, ">");
+	}
+}
+
+static int out_pipe_f(char **argvv[], void *opaque) {
+	char **argv;
+	for (; *argvv; argvv++) {
+		out_argv(opaque, *argvv);
+		for (argv=*argvv; *argv; argv++)
+			;
+		for (argv++; *argv; argv++) {
+			out_add(opaque, "{");
+			out_add(opaque, *argv);
+			out_add(opaque, "}");
+		}
+	}
+	return 0;
+}
+
+static char *glob(const char *pattern) {
+	static struct out o;
+	char **matches=_execs_glob(pattern);
+	o.len=0;
+	*o.buf=0;
+	if (matches == NULL)
+		return (errno == ENOENT) ? "ENOENT" : "error";
+	out_argv(&o, matches);
+	free(matches);
+	return o.buf;
+}
+
+static char *multipipe(const char *args, int flags) {
+	static struct out o;
+	o.len=0;
+	*o.buf=0;
+	if (s2multipipe(args, out_pipe_f, &o, flags) < 0)
+		return "error";
+	return o.buf;
+}
+
+static void touch(const char *path) {
+	int fd=open(path, O_WRONLY | O_CREAT, 0644);
+	if (fd >= 0)
+		close(fd);
+}
+
+/* the mtime of the directory, some time ago (listings of directories
+	 modified in the last seconds are not cached) */
+static void age(const char *path, time_t sec) {
+	struct timespec times[2]={{sec, 0}, {sec, 0}};
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+static void test_glob(const char *dir) {
+	char pattern[256];
+	char expected[512];
+	CHECK(strcmp(glob("*.txt"), "<a.txt><b.txt>") == 0, "*.txt: %s", glob("*.txt"));
+	CHECK(strcmp(glob("*"), "<a.txt><b.txt><c.log><sub>") == 0, "hidden files: %s", glob("*"));
+	CHECK(strcmp(glob(".h*"), "<.hidden>") == 0, ".h*: %s", glob(".h*"));
+	CHECK(strcmp(glob("?.[lt]*"), "<a.txt><b.txt><c.log>") == 0, "?.[lt]*: %s", glob("?.[lt]*"));
+	CHECK(strcmp(glob("sub/*.c"), "<sub/x.c><sub/y.c>") == 0, "sub/*.c: %s", glob("sub/*.c"));
+	CHECK(strcmp(glob("*/y.c"), "<sub/y.c>") == 0, "*/y.c: %s", glob("*/y.c"));
+	CHECK(strcmp(glob("s*/*"), "<sub/x.c><sub/y.c>") == 0, "s*/*: %s", glob("s*/*"));
+	CHECK(strcmp(glob("*.none"), "ENOENT") == 0, "*.none: %s", glob("*.none"));
+	CHECK(strcmp(glob("nodir/*"), "ENOENT") == 0, "nodir/*: %s", glob("nodir/*"));
+	snprintf(pattern, sizeof(pattern), "%s/*.log", dir);
+	snprintf(expected, sizeof(expected), "<%s/c.log>", dir);
+	CHECK(strcmp(glob(pattern), expected) == 0, "%s: %s", pattern, glob(pattern));
+}
+
+static void test_multipipe(void) {
+	const char *s;
+	s=multipipe("echo *.txt '*.txt' \"b*\" \\*.txt none* sub/*", EXECS_GLOB);
+	CHECK(strcmp(s, "<echo><a.txt><b.txt><*.txt><b*><*.txt><none*><sub/x.c><sub/y.c>") == 0,
+			"EXECS_GLOB: %s", s);
+	s=multipipe("echo *.txt", 0);
+	CHECK(strcmp(s, "<echo><*.txt>") == 0, "no EXECS_GLOB: %s", s);
+	s=multipipe("cat <*.log c* >*.txt | wc *.log", EXECS_GLOB);
+	CHECK(strcmp(s, "<cat><c.log>{<}{*.log}{>}{*.txt}<wc><c.log>") == 0, "redirections: %s", s);
+	setenv("GLOBVAR", "*.txt", 1);
+	s2argv_getvar=getenv;
+	s=multipipe("echo $GLOBVAR", EXECS_GLOB);
+	CHECK(strcmp(s, "<echo><*.txt>") == 0, "variables: %s", s);
+	s2argv_getvar=NULL;
+}
+
+static void test_system(void) {
+	struct execs_capture cap={NULL, 0, 0, 0};
+	CHECK(_system_capture(NULL, "echo *.txt sub/*", &cap, EXECS_NOSEQ | EXECS_GLOB) == 0 &&
+			strcmp(cap.buf, "a.txt b.txt sub/x.c sub/y.c\n") == 0, "system: \"%s\"", cap.buf);
+	execs_capture_free(&cap);
+}
+
+static void test_cache(void) {
+	time_t old=time(NULL) - 60;
+	struct stat sbuf;
+	age("sub", old);
+	CHECK(strcmp(glob("sub/*"), "<sub/x.c><sub/y.c>") == 0, "sub/*: %s", glob("sub/*"));
+	/* a new file changes the mtime: the listing is read again */
+	touch("sub/z.c");
+	CHECK(strcmp(glob("sub/*"), "<sub/x.c><sub/y.c><sub/z.c>") == 0, "new file: %s", glob("sub/*"));
+	/* the listing of a directory modified in the last seconds is not cached */
+	unlink("sub/z.c");
+	CHECK(strcmp(glob("sub/*"), "<sub/x.c><sub/y.c>") == 0, "deleted file: %s", glob("sub/*"));
+	age("sub", old);
+	CHECK(strcmp(glob("sub/*"), "<sub/x.c><sub/y.c>") == 0, "sub/*: %s", glob("sub/*"));
+	/* same mtime: the cached listing is used */
+	touch("sub/w.c");
+	age("sub", old);
+	CHECK(stat("sub/w.c", &sbuf) == 0, "touch");
+	CHECK(strcmp(glob("sub/*"), "<sub/x.c><sub/y.c>") == 0, "cached listing: %s", glob("sub/*"));
+	age("sub", old + 1);
+	CHECK(strcmp(glob("sub/*"), "<sub/w.c><sub/x.c><sub/y.c>") == 0, "mtime: %s", glob("sub/*"));
+}
+
+int main(int argc, char *argv[]) {
+	char dir[]="/tmp/globXXXXXX";
+	char rm[64];
+	if (mkdtemp(dir) == NULL || chdir(dir) < 0)
+		return perror("glob"), 1;
+	touch("a.txt");
+	touch("b.txt");
+	touch("c.log");
+	touch(".hidden");
+	mkdir("sub", 0755);
+	touch("sub/y.c");
+	touch("sub/x.c");
+	test_glob(dir);
+	test_multipipe();
+	test_system();
+	test_cache();
+	if (chdir("/") == 0) {
+		snprintf(rm, sizeof(rm), "rm -rf %s", dir);
+		system_execsp(rm);
+	}
+	if (errors) {
+		fprintf(stderr, "glob: %d errors\n", errors);
+		return 1;
+	}
+	printf("glob: no errors\n");
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * hppdiff: the compile time parser of execs.hpp vs s2argv
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* execs.hpp has its own copy of the FSA tables of execs.c: execs::fsa::parse
+	 (the parser of execs::cmd) must give the same argv of s2argv on the
+	 strings of fsadiff (strings including variables are compile time errors
+	 for execs::cmd, they are skipped).
+	 Usage: hppdiff [iterations [seed]] */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <execs.hpp>
+#include "corpus.h"
+
+/* <arg> for each argument, | at the end of each command */
+static std::string out_argv(char *const *argv)
+{
+	std::string out;
+	for (; *argv; argv++) {
+		for (; *argv; argv++)
+			out += std::string("<") + *argv + ">";
+		out += "|";
+	}
+	return out;
+}
+
+/* execs::cmd at compile time */
+static_assert(execs::cmd<"ls -l /tmp">::argvlen == 4);
+static_assert(execs::cmd<"a|b c>d 2>&1">::argvlen == 4);
+static_assert(execs::cmd<"a; b">::argvlen == 4);
+
+template <execs::fixed_string S>
+static int check_cmd()
+{
+	char **ref=s2argv(S.s);
+	std::string refout=out_argv(ref);
+	std::string newout=out_argv(execs::cmd<S>::argv());
+	s2argv_free(ref);
+	if (refout == newout)
+		return 0;
+	std::fprintf(stderr, "cmd<\"%s\">:\n  s2argv %s\n  cmd    %s\n", S.s,
+			refout.c_str(), newout.c_str());
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations=(argc > 1) ? std::atol(argv[1]) : 200000;
+	unsigned int seed=(argc > 2) ? std::atoi(argv[2]) : 42;
+	char args[512];
+	long i;
+	long skipped=0;
+	int errors=0;
+	errors += check_cmd<"ls -l /tmp">();
+	errors += check_cmd<"a|b c>d 2>&1 <e &">();
+	errors += check_cmd<"echo 'x;y' \"a b\" c\\ d; ls|wc">();
+	errors += check_cmd<";; a ;">();
+	srandom(seed);
+	for (i=0; i<iterations && errors < 10; i++) {
+		corpus_gen(args, (i % 16 == 0) ? sizeof(args) : 48);
+		execs::fsa::layout l=execs::fsa::parse(args, nullptr, nullptr);
+		if (l.error) {
+			skipped++;
+			continue;
+		}
+		std::vector<char> buf(l.len + 1);
+		std::vector<long> off(l.n);
+		std::vector<char *> newargv(l.n);
+		execs::fsa::parse(args, buf.data(), off.data());
+		for (std::size_t j=0; j<l.n; j++)
+			newargv[j]=(off[j] < 0) ? nullptr : &buf[off[j]];
+		char **ref=s2argv(args);
+		if (ref == NULL)
+			return std::perror("s2argv"), 1;
+		std::string refout=out_argv(ref);
+		std::string newout=out_argv(newargv.data());
+		s2argv_free(ref);
+		if (refout != newout) {
+			std::fprintf(stderr, "mismatch\n  input: \"%s\"\n  s2argv: %s\n  hpp:    %s\n",
+					args, refout.c_str(), newout.c_str());
+			errors++;
+		}
+	}
+	if (errors)
+		return 1;
+	std::printf("hppdiff: %ld inputs (%ld with variables skipped), no differences\n", i, skipped);
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * pipeline: pipelines run by system and popen
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the commands of a pipeline are connected by pipes, the status is the one
+	 of the last command, popen streams are connected to the first (w) or to
+	 the last (r) command. Syntax errors and EXECS_NOPIPE fail with EINVAL,
+	 quoted | are literal */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+/* the output of cmd run by popen_nosh, "" in case of error */
+static char *readall(const char *cmd, char *buf, size_t len) {
+	FILE *f=popen_nosh(cmd, "r");
+	size_t n=0;
+	*buf=0;
+	if (f) {
+		n=fread(buf, 1, len - 1, f);
+		buf[n]=0;
+		pclose_nosh(f);
+	}
+	return buf;
+}
+
+static void test_system(void) {
+	CHECK(system_execsp("true | false") == W_EXITCODE(1, 0), "status of the last command");
+	CHECK(system_execsp("false | true") == 0, "status of the last command");
+	CHECK(system_execsp("sh -c 'exit 2' | sh -c 'exit 3' | sh -c 'exit 4'") == W_EXITCODE(4, 0),
+			"three commands");
+	/* the writer gets SIGPIPE when the reader terminates */
+	CHECK(system_execsp("yes | head -c 0") == 0, "SIGPIPE");
+	/* a failing pipeline stops a sequence */
+	CHECK(system_nosh("false | true; true | false; true") == W_EXITCODE(1, 0), "sequence");
+}
+
+static void test_syntax(void) {
+	const char *invalid[]={"ls |", "| ls", "ls || wc", "ls | ; wc", NULL};
+	const char **s;
+	for (s=invalid; *s; s++) {
+		errno=0;
+		CHECK(system_execsp(*s) == W_EXITCODE(127, 0), "\"%s\" is not a syntax error", *s);
+		CHECK(errno == EINVAL, "\"%s\": errno %d", *s, errno);
+	}
+	errno=0;
+	CHECK(_system_common(NULL, "true | true", NULL, EXECS_NOSEQ | EXECS_NOPIPE) == W_EXITCODE(127, 0) &&
+			errno == EINVAL, "EXECS_NOPIPE");
+	errno=0;
+	CHECK(system_safe("/bin/true | /bin/true") == W_EXITCODE(127, 0) && errno == EINVAL,
+			"system_safe runs a pipeline");
+	errno=0;
+	CHECK(popen_execsp("ls |", "r") == NULL && errno == EINVAL, "popen \"ls |\"");
+}
+
+static void test_popen(void) {
+	char buf[256];
+	FILE *f;
+	CHECK(strcmp(readall("printf 'b\\na\\n' | sort", buf, sizeof(buf)), "a\nb\n") == 0,
+			"popen r: \"%s\"", buf);
+	CHECK(strcmp(readall("echo hello | cat | cat | cat | tr a-z A-Z", buf, sizeof(buf)),
+				"HELLO\n") == 0, "long pipeline: \"%s\"", buf);
+	/* quoted: literal */
+	CHECK(strcmp(readall("echo 'a|b' \"c | d\" e\\|f", buf, sizeof(buf)), "a|b c | d e|f\n") == 0,
+			"quoted |: \"%s\"", buf);
+	/* the stream is the input of the first command, pclose returns the status
+		 of the last command */
+	f=popen_execsp("cat | sh -c 'read x; exit $x'", "w");
+	CHECK(f != NULL, "popen w: %s", strerror(errno));
+	if (f) {
+		fputs("7\n", f);
+		CHECK(pclose_execsp(f) == W_EXITCODE(7, 0), "popen w status");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	test_system();
+	test_syntax();
+	test_popen();
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "stray children");
+	if (errors) {
+		fprintf(stderr, "pipeline: %d errors\n", errors);
+		return 1;
+	}
+	printf("pipeline: no errors\n");
+	return 0;
+}
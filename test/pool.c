@@ -0,0 +1,251 @@
+/*
+ * pool: persistent coprocess worker pools
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* workers are reused (the response includes the pid of the worker), at
+	 most maxworkers run, concurrent calls get their own responses, both
+	 framings, workers which terminate are replaced (without waiting for them),
+	 coprocess_pool_free waits for the busy workers and cancels the calls
+	 waiting for a worker. No children are left behind */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+static pthread_mutex_t errmutex=PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		pthread_mutex_lock(&errmutex); \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+		pthread_mutex_unlock(&errmutex); \
+	} \
+} while (0)
+
+/* the response is "pid request" */
+#define PIDECHO "sh -c 'while read l; do echo $$ $l; done'"
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void check_children(const char *what) {
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "%s: stray children", what);
+}
+
+/* the pid of the worker, 0 if the response is not "pid req" */
+static long call(struct coprocess_pool *pool, const char *req) {
+	char *resp=NULL;
+	long pid=0;
+	char *sp;
+	ssize_t n=coprocess_pool_call(pool, req, strlen(req), &resp);
+	if (n > 0 && (size_t) n == strlen(resp) && (sp=strchr(resp, ' ')) != NULL &&
+			strcmp(sp + 1, req) == 0)
+		pid=strtol(resp, NULL, 10);
+	free(resp);
+	return pid;
+}
+
+static void test_reuse(void) {
+	struct coprocess_pool *pool=coprocsp_pool(PIDECHO, EXECS_POOL_LINE, 1, 1);
+	long pid;
+	int i;
+	char req[32];
+	CHECK(pool != NULL, "coprocsp_pool: %s", strerror(errno));
+	if (pool == NULL)
+		return;
+	pid=call(pool, "first");
+	CHECK(pid > 0, "first call");
+	for (i=0; i<100; i++) {
+		snprintf(req, sizeof(req), "req %d", i);
+		CHECK(call(pool, req) == pid, "the worker has not been reused");
+	}
+	errno=0;
+	CHECK(coprocess_pool_call(pool, "a\nb", 3, NULL) == -1 && errno == EINVAL, "newline");
+	coprocess_pool_free(pool);
+	check_children("reuse");
+}
+
+#define NTHREADS 8
+#define NCALLS 200
+#define MAXWORKERS 3
+
+struct concurrent_t {
+	struct coprocess_pool *pool;
+	int id;
+	long pids[NCALLS];
+};
+
+static void *concurrent(void *arg) {
+	struct concurrent_t *c=arg;
+	char req[32];
+	int i;
+	for (i=0; i<NCALLS; i++) {
+		snprintf(req, sizeof(req), "thread %d call %d", c->id, i);
+		c->pids[i]=call(c->pool, req);
+		CHECK(c->pids[i] > 0, "thread %d call %d: wrong response", c->id, i);
+	}
+	return NULL;
+}
+
+static void test_concurrent(void) {
+	struct coprocess_pool *pool=coprocsp_pool(PIDECHO, EXECS_POOL_LINE, 0, MAXWORKERS);
+	pthread_t threads[NTHREADS];
+	static struct concurrent_t c[NTHREADS];
+	long pids[MAXWORKERS + 1];
+	int npids=0;
+	int i, j, k;
+	CHECK(pool != NULL, "coprocsp_pool: %s", strerror(errno));
+	if (pool == NULL)
+		return;
+	for (i=0; i<NTHREADS; i++) {
+		c[i].pool=pool;
+		c[i].id=i;
+		pthread_create(&threads[i], NULL, concurrent, &c[i]);
+	}
+	for (i=0; i<NTHREADS; i++)
+		pthread_join(threads[i], NULL);
+	for (i=0; i<NTHREADS; i++) {
+		for (j=0; j<NCALLS && npids <= MAXWORKERS; j++) {
+			for (k=0; k<npids && pids[k] != c[i].pids[j]; k++)
+				;
+			if (k == npids)
+				pids[npids++]=c[i].pids[j];
+		}
+	}
+	CHECK(npids <= MAXWORKERS, "more than %d workers", MAXWORKERS);
+	coprocess_pool_free(pool);
+	check_children("concurrent");
+}
+
+/* cat returns each frame as it is */
+static void test_len32(void) {
+	struct coprocess_pool *pool=coprocsp_pool("cat", EXECS_POOL_LEN32, 1, 2);
+	char req[100000];
+	char *resp=NULL;
+	size_t i;
+	CHECK(pool != NULL, "coprocsp_pool: %s", strerror(errno));
+	if (pool == NULL)
+		return;
+	for (i=0; i<sizeof(req); i++)
+		req[i]=i % 251;
+	CHECK(coprocess_pool_call(pool, req, sizeof(req), &resp) == sizeof(req) &&
+			memcmp(req, resp, sizeof(req)) == 0, "binary frame");
+	free(resp);
+	resp=NULL;
+	CHECK(coprocess_pool_call(pool, "", 0, &resp) == 0 && resp != NULL && *resp == 0,
+			"empty frame");
+	free(resp);
+	coprocess_pool_free(pool);
+	check_children("len32");
+}
+
+/* each worker answers one request, then it closes its pipes and keeps
+	 running for a while: the next call gets EOF and uses a new worker,
+	 without waiting for the old one */
+static void test_replace(void) {
+	struct coprocess_pool *pool=coprocsp_pool(
+			"sh -c 'read l; echo $$ $l; exec sleep 5 <&- >&-'", EXECS_POOL_LINE, 1, 1);
+	long pid, newpid;
+	long long start;
+	int i;
+	CHECK(pool != NULL, "coprocsp_pool: %s", strerror(errno));
+	if (pool == NULL)
+		return;
+	pid=call(pool, "a");
+	CHECK(pid > 0, "first call");
+	/* the old workers would take 5 * COPROC_POOL_GRACE (100ms) to be killed */
+	start=now_ms();
+	for (i=0; i<5; i++) {
+		newpid=call(pool, "b");
+		CHECK(newpid > 0 && newpid != pid, "the worker has not been replaced");
+		pid=newpid;
+	}
+	CHECK(now_ms() - start < 400, "the calls have waited for the old workers");
+	start=now_ms();
+	coprocess_pool_free(pool);
+	CHECK(now_ms() - start < 2000, "coprocess_pool_free");
+	check_children("replace");
+}
+
+struct slow_t {
+	struct coprocess_pool *pool;
+	ssize_t rv;
+	int err;
+};
+
+static void *slow_call(void *arg) {
+	struct slow_t *s=arg;
+	char *resp=NULL;
+	s->rv=coprocess_pool_call(s->pool, "x", 1, &resp);
+	s->err=errno;
+	free(resp);
+	return NULL;
+}
+
+static void test_free(void) {
+	struct coprocess_pool *pool=coprocsp_pool(
+			"sh -c 'while read l; do sleep 0.3; echo $l; done'", EXECS_POOL_LINE, 1, 1);
+	pthread_t busy, waiting;
+	struct slow_t b, w;
+	CHECK(pool != NULL, "coprocsp_pool: %s", strerror(errno));
+	if (pool == NULL)
+		return;
+	b=w=(struct slow_t) {pool, 0, 0};
+	pthread_create(&busy, NULL, slow_call, &b);
+	usleep(50000);
+	pthread_create(&waiting, NULL, slow_call, &w);
+	usleep(50000);
+	coprocess_pool_free(pool);
+	pthread_join(busy, NULL);
+	pthread_join(waiting, NULL);
+	CHECK(b.rv == 1, "the busy call has failed: %s", strerror(b.err));
+	CHECK(w.rv == -1 && w.err == ECANCELED, "the waiting call: %zd %s", w.rv, strerror(w.err));
+	check_children("free");
+}
+
+int main(int argc, char *argv[]) {
+	errno=0;
+	CHECK(coprocsp_pool("cat", EXECS_POOL_LINE, 2, 1) == NULL && errno == EINVAL, "min > max");
+	CHECK(coprocsp_pool("cat", 42, 0, 1) == NULL && errno == EINVAL, "framing");
+	test_reuse();
+	test_concurrent();
+	test_len32();
+	test_replace();
+	test_free();
+	if (errors) {
+		fprintf(stderr, "pool: %d errors\n", errors);
+		return 1;
+	}
+	printf("pool: no errors\n");
+	return 0;
+}
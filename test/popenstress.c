@@ -0,0 +1,150 @@
+/*
+ * popenstress: many concurrent popen streams
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Several threads open thousands of popen streams at the same time
+	 (the table of the streams grows while other threads use it), then
+	 read them and close them in a different order. Each stream must get the
+	 output and the exit status of its own command.
+	 Usage: popenstress [threads [streams_per_thread]] */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int nthreads=4;
+static int nstreams=1024;
+static pthread_barrier_t barrier;
+
+/* streams is allocated before starting the threads: all the threads
+	 reach the barriers */
+struct stress_t {
+	int id;
+	int errors;
+	FILE **streams;
+};
+
+static void *stress(void *arg) {
+	struct stress_t *t=arg;
+	FILE **streams=t->streams;
+	char cmd[64];
+	int i;
+	pthread_barrier_wait(&barrier);
+	/* odd streams run a pipeline, one stream every 8 exits with status 3 */
+	for (i=0; i<nstreams; i++) {
+		if (i % 8 == 7)
+			snprintf(cmd, sizeof(cmd), "sh -c 'echo %d %d; exit 3'", t->id, i);
+		else if (i % 2)
+			snprintf(cmd, sizeof(cmd), "echo %d %d | cat", t->id, i);
+		else
+			snprintf(cmd, sizeof(cmd), "echo %d %d", t->id, i);
+		if ((streams[i]=popen_nosh(cmd, "re")) == NULL) {
+			fprintf(stderr, "thread %d: popen %d: %s\n", t->id, i, strerror(errno));
+			t->errors++;
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	/* backwards: the fds are not released in the order they were taken */
+	for (i=nstreams-1; i>=0; i--) {
+		char line[64];
+		char expected[64];
+		int status;
+		if (streams[i] == NULL)
+			continue;
+		snprintf(expected, sizeof(expected), "%d %d\n", t->id, i);
+		if (fgets(line, sizeof(line), streams[i]) == NULL || strcmp(line, expected) != 0) {
+			fprintf(stderr, "thread %d: stream %d: wrong output\n", t->id, i);
+			t->errors++;
+		}
+		status=pclose_nosh(streams[i]);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != ((i % 8 == 7) ? 3 : 0)) {
+			fprintf(stderr, "thread %d: stream %d: status %x\n", t->id, i, status);
+			t->errors++;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	struct rlimit rl;
+	pthread_t *threads;
+	struct stress_t *t;
+	int errors=0;
+	int i;
+	if (argc > 1)
+		nthreads=atoi(argv[1]);
+	if (argc > 2)
+		nstreams=atoi(argv[2]);
+	if (nthreads <= 0 || nstreams <= 0) {
+		fprintf(stderr, "usage: %s [threads [streams_per_thread]]\n", argv[0]);
+		return 2;
+	}
+	/* one fd for each stream, plus a few for the pipes being created */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rlim_t needed=(rlim_t) nthreads * nstreams + 64;
+		if (rl.rlim_cur < needed) {
+			rl.rlim_cur=(rl.rlim_max < needed) ? rl.rlim_max : needed;
+			setrlimit(RLIMIT_NOFILE, &rl);
+		}
+		if (rl.rlim_cur < needed) {
+			nstreams=(rl.rlim_cur - 64) / nthreads;
+			fprintf(stderr, "popenstress: RLIMIT_NOFILE too low, %d streams per thread\n",
+					nstreams);
+		}
+	}
+	threads=calloc(nthreads, sizeof(pthread_t));
+	t=calloc(nthreads, sizeof(struct stress_t));
+	if (threads == NULL || t == NULL)
+		return 1;
+	for (i=0; i<nthreads; i++) {
+		if ((t[i].streams=calloc(nstreams, sizeof(FILE *))) == NULL)
+			return 1;
+	}
+	pthread_barrier_init(&barrier, NULL, nthreads);
+	for (i=0; i<nthreads; i++) {
+		t[i].id=i;
+		pthread_create(&threads[i], NULL, stress, &t[i]);
+	}
+	for (i=0; i<nthreads; i++) {
+		pthread_join(threads[i], NULL);
+		errors += t[i].errors;
+		free(t[i].streams);
+	}
+	pthread_barrier_destroy(&barrier);
+	/* a stream which has not been opened by popen */
+	if (pclose_nosh(stdin) != -1 || errno != EINVAL) {
+		fprintf(stderr, "pclose of a non popen stream\n");
+		errors++;
+	}
+	free(threads);
+	free(t);
+	if (errors) {
+		fprintf(stderr, "popenstress: %d errors\n", errors);
+		return 1;
+	}
+	printf("popenstress: %d threads, %d concurrent streams, no errors\n",
+			nthreads, nthreads * nstreams);
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * redir: redirections of the standard descriptors
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* <, >, >>, n>&m and explicit descriptor numbers, also in pipelines and
+	 after the redir argument of system_execsrp. Invalid redirections
+	 (e.g. "12>x", a missing target) fail with EINVAL, quoted operators
+	 are literal. The test runs in a temporary directory */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+/* the contents of the file path ("" if it does not exist) */
+static char *content(const char *path) {
+	static char buf[256];
+	int fd=open(path, O_RDONLY);
+	ssize_t n=0;
+	if (fd >= 0) {
+		n=read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+	}
+	buf[n > 0 ? n : 0]=0;
+	return buf;
+}
+
+static void test_files(void) {
+	CHECK(system_execsp("echo hello >out") == 0 && strcmp(content("out"), "hello\n") == 0,
+			">: \"%s\"", content("out"));
+	CHECK(system_execsp("echo again >out") == 0 && strcmp(content("out"), "again\n") == 0,
+			"> truncates: \"%s\"", content("out"));
+	CHECK(system_execsp("echo more >>out") == 0 && strcmp(content("out"), "again\nmore\n") == 0,
+			">> appends: \"%s\"", content("out"));
+	CHECK(system_execsp("tr a-z A-Z <out >up") == 0 && strcmp(content("up"), "AGAIN\nMORE\n") == 0,
+			"<: \"%s\"", content("up"));
+	CHECK(system_execsp("cat 0<out 1>cp") == 0 && strcmp(content("cp"), "again\nmore\n") == 0,
+			"explicit descriptors: \"%s\"", content("cp"));
+	CHECK(system_execsp("cat <nonexistent") == W_EXITCODE(127, 0), "missing input file");
+}
+
+static void test_dup(void) {
+	CHECK(system_execsp("sh -c 'echo err >&2' >out 2>&1") == 0 &&
+			strcmp(content("out"), "err\n") == 0, "2>&1: \"%s\"", content("out"));
+	/* left to right, as in the shell: stderr goes to the old stdout */
+	CHECK(system_execsp("sh -c 'echo err >&2' 2>&1 >out 2>/dev/null") == 0 &&
+			strcmp(content("out"), "") == 0, "order: \"%s\"", content("out"));
+	CHECK(system_execsp("sh -c 'echo o; echo e >&2' 2>>out >>out") == 0 &&
+			strcmp(content("out"), "o\ne\n") == 0, "2>>: \"%s\"", content("out"));
+	/* m is not open */
+	errno=0;
+	CHECK(system_execsp("echo a 2>&7") == W_EXITCODE(127, 0), "2>&7");
+}
+
+static void test_pipeline(void) {
+	char buf[64];
+	FILE *f;
+	size_t n;
+	int redir[3]={-1, open("cp", O_WRONLY | O_TRUNC), -1};
+	CHECK(system_execsp("printf 'b\\na\\n' >in") == 0, "printf");
+	CHECK(system_execsp("sort <in | tr a-z A-Z >out 2>/dev/null") == 0 &&
+			strcmp(content("out"), "A\nB\n") == 0, "pipeline: \"%s\"", content("out"));
+	/* the redirection of the string overrides the pipe */
+	CHECK(system_execsp("echo lost >out | cat >cp") == 0 &&
+			strcmp(content("out"), "lost\n") == 0 && strcmp(content("cp"), "") == 0,
+			"redirection vs pipe");
+	/* and the redir argument */
+	CHECK(system_execsrp("echo x >out", redir) == 0 && strcmp(content("out"), "x\n") == 0 &&
+			strcmp(content("cp"), "") == 0, "redirection vs redir[]");
+	CHECK(system_execsrp("echo y", redir) == 0 && strcmp(content("cp"), "y\n") == 0,
+			"redir[]");
+	close(redir[1]);
+	f=popen_execsp("sh -c 'echo e >&2' 2>&1", "r");
+	CHECK(f != NULL, "popen: %s", strerror(errno));
+	if (f) {
+		n=fread(buf, 1, sizeof(buf) - 1, f);
+		buf[n]=0;
+		CHECK(strcmp(buf, "e\n") == 0, "popen 2>&1: \"%s\"", buf);
+		pclose_execsp(f);
+	}
+}
+
+static void test_syntax(void) {
+	const char *invalid[]={"echo a 12>x", "echo a 99<x", "echo a >", "echo a <", "echo a >>",
+		"echo a > >x", "echo a 2>&", "echo a 3>&1", "echo a <<x", "echo a >|x", "> ; x", NULL};
+	const char **s;
+	char buf[64];
+	FILE *f;
+	size_t n;
+	for (s=invalid; *s; s++) {
+		errno=0;
+		CHECK(system_execsp(*s) == W_EXITCODE(127, 0) && errno == EINVAL,
+				"\"%s\" is not a syntax error", *s);
+	}
+	CHECK(access("x", F_OK) != 0, "a file has been created by an invalid command");
+	errno=0;
+	CHECK(_system_common(NULL, "echo a >out", NULL, EXECS_NOSEQ | EXECS_NOREDIR) == W_EXITCODE(127, 0) &&
+			errno == EINVAL, "EXECS_NOREDIR");
+	errno=0;
+	CHECK(system_safe("/bin/echo >out") == W_EXITCODE(127, 0) && errno == EINVAL,
+			"system_safe redirects");
+	/* quoted, escaped or part of an argument: literal */
+	f=popen_execsp("echo '>x' \\<y \"2>&1\" a&b", "r");
+	CHECK(f != NULL, "popen: %s", strerror(errno));
+	if (f) {
+		n=fread(buf, 1, sizeof(buf) - 1, f);
+		buf[n]=0;
+		CHECK(strcmp(buf, ">x <y 2>&1 a&b\n") == 0, "literal: \"%s\"", buf);
+		pclose_execsp(f);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	char dir[]="/tmp/redirXXXXXX";
+	if (mkdtemp(dir) == NULL || chdir(dir) < 0)
+		return perror("redir"), 1;
+	test_files();
+	test_dup();
+	test_pipeline();
+	test_syntax();
+	if (chdir("/") == 0) {
+		char rm[64];
+		snprintf(rm, sizeof(rm), "rm -rf %s", dir);
+		system_execsp(rm);
+	}
+	if (errors) {
+		fprintf(stderr, "redir: %d errors\n", errors);
+		return 1;
+	}
+	printf("redir: no errors\n");
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * spawn: the spawn engine (clone with CLONE_VM|CLONE_VFORK, or fork)
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the child of a vfork spawn shares the memory of the parent (a write of
+	 the child is seen by the parent), the child of a fork spawn does not.
+	 execs_fork_security makes the engine fall back to fork (but with
+	 EXECS_SPAWN_HOOKSAFE), a hook failure means exit status 127. A child
+	 sharing the memory of the parent does not run its signal handlers.
+	 system, popen and coprocesses work in both modes */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+static volatile int shared;
+static volatile int hookcalls;
+static volatile sig_atomic_t handled;
+
+static int set_shared(void *arg) {
+	shared=*(int *) arg;
+	return 5;
+}
+
+static int hook(void *arg) {
+	hookcalls++;
+	return *(int *) arg;
+}
+
+static void handler(int sig) {
+	handled++;
+}
+
+static int raise_usr1(void *arg) {
+	raise(SIGUSR1);
+	return 0;
+}
+
+static int spawn_wait(pid_t pid) {
+	int status;
+	if (pid == -1 || waitpid(pid, &status, 0) != pid)
+		return -1;
+	return status;
+}
+
+/* 1 if the child has written the memory of the parent */
+static int spawn_shares(const struct execs_ctx *ctx, int *status) {
+	static int value=0;
+	value++;
+	*status=spawn_wait(_execs_spawn_ctx(ctx, set_shared, &value, 0));
+	return shared == value;
+}
+
+static void test_modes(void) {
+	int status;
+	int fail=1, ok=0;
+	struct execs_ctx ctx;
+	CHECK(execs_spawn_mode == EXECS_SPAWN_VFORK, "the default mode is not vfork");
+	CHECK(spawn_shares(NULL, &status) && status == W_EXITCODE(5, 0), "vfork: %x", status);
+	execs_spawn_mode=EXECS_SPAWN_FORK;
+	CHECK(!spawn_shares(NULL, &status) && status == W_EXITCODE(5, 0), "fork: %x", status);
+	execs_spawn_mode=EXECS_SPAWN_VFORK;
+	/* the hook gets a full child */
+	execs_fork_security=hook;
+	execs_fork_security_arg=&ok;
+	CHECK(!spawn_shares(NULL, &status) && status == W_EXITCODE(5, 0), "hook: %x", status);
+	execs_spawn_mode=EXECS_SPAWN_VFORK | EXECS_SPAWN_HOOKSAFE;
+	hookcalls=0;
+	CHECK(spawn_shares(NULL, &status) && status == W_EXITCODE(5, 0) && hookcalls == 1,
+			"hooksafe: %x", status);
+	execs_fork_security_arg=&fail;
+	CHECK(!spawn_shares(NULL, &status) && status == W_EXITCODE(127, 0), "hook failure: %x", status);
+	CHECK(system_execsp("true") == W_EXITCODE(127, 0), "system: hook failure");
+	execs_fork_security=NULL;
+	execs_spawn_mode=EXECS_SPAWN_VFORK;
+	/* contexts */
+	execs_ctx_init(&ctx);
+	ctx.spawn_mode=EXECS_SPAWN_FORK;
+	CHECK(!spawn_shares(&ctx, &status) && status == W_EXITCODE(5, 0), "ctx fork: %x", status);
+	ctx.spawn_mode=EXECS_SPAWN_VFORK;
+	CHECK(spawn_shares(&ctx, &status) && status == W_EXITCODE(5, 0), "ctx vfork: %x", status);
+	ctx.fork_security=hook;
+	ctx.fork_security_arg=&fail;
+	CHECK(!spawn_shares(&ctx, &status) && status == W_EXITCODE(127, 0), "ctx hook: %x", status);
+}
+
+static void test_signals(void) {
+	int status;
+	signal(SIGUSR1, handler);
+	status=spawn_wait(_execs_spawn(raise_usr1, NULL, 0));
+	CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGUSR1 && handled == 0,
+			"the child has run the handler of the parent: %x", status);
+	signal(SIGUSR1, SIG_DFL);
+}
+
+static void test_commands(int mode) {
+	char buf[64];
+	int pfd[2];
+	FILE *f;
+	ssize_t n;
+	pid_t pid;
+	execs_spawn_mode=mode;
+	CHECK(system_execsp("sh -c 'exit 3'") == W_EXITCODE(3, 0), "mode %d: system", mode);
+	CHECK(system_execsp("/nonexistent") == W_EXITCODE(127, 0), "mode %d: exec failure", mode);
+	f=popen_execsp("echo a b | tr ab AB", "r");
+	CHECK(f != NULL && fgets(buf, sizeof(buf), f) != NULL && strcmp(buf, "A B\n") == 0,
+			"mode %d: popen", mode);
+	CHECK(f != NULL && pclose_execsp(f) == 0, "mode %d: pclose", mode);
+	pid=coprocsp("cat", pfd);
+	CHECK(pid > 0, "mode %d: coprocsp", mode);
+	if (pid > 0) {
+		CHECK(write(pfd[1], "ping", 4) == 4, "write");
+		close(pfd[1]);
+		n=read(pfd[0], buf, sizeof(buf));
+		CHECK(n == 4 && memcmp(buf, "ping", 4) == 0, "mode %d: coprocess", mode);
+		close(pfd[0]);
+		CHECK(spawn_wait(pid) == 0, "mode %d: coprocess status", mode);
+	}
+	execs_spawn_mode=EXECS_SPAWN_VFORK;
+}
+
+int main(int argc, char *argv[]) {
+	test_modes();
+	test_signals();
+	test_commands(EXECS_SPAWN_VFORK);
+	test_commands(EXECS_SPAWN_FORK);
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "stray children");
+	if (errors) {
+		fprintf(stderr, "spawn: %d errors\n", errors);
+		return 1;
+	}
+	printf("spawn: no errors\n");
+	return 0;
+}
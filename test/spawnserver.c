@@ -0,0 +1,100 @@
+/*
+ * spawnserver: processes created by the spawn server
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* the server is started by a thread which terminates at once: it must
+	 survive it. The processes it creates are children of the test, with the
+	 descriptors and working directory of the caller. A child created by
+	 fork(2) creates processes by itself. execs_server_stop terminates the
+	 server (the server is the only other child of the test) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+/* the thread terminates after the server has completed its setup */
+static void *start(void *arg) {
+	*(int *) arg=execs_server_start();
+	usleep(100000);
+	return NULL;
+}
+
+/* 0: the server is running (it is the only child) */
+static int server_alive(void) {
+	return waitpid(-1, NULL, WNOHANG) == 0;
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t thread;
+	int rv=-1;
+	char buf[256];
+	FILE *f;
+	pid_t pid;
+	int status;
+	pthread_create(&thread, NULL, start, &rv);
+	pthread_join(thread, NULL);
+	CHECK(rv == 0, "execs_server_start: %s", strerror(errno));
+	usleep(100000);
+	CHECK(server_alive(), "the server has terminated with its thread");
+	CHECK(execs_server_start() == 0, "execs_server_start is not idempotent");
+
+	CHECK(system_execsp("sh -c 'exit 3'") == W_EXITCODE(3, 0), "exit status");
+	/* working directory and descriptors of the caller */
+	CHECK(chdir("/") == 0, "chdir");
+	f=popen_execsp("pwd", "r");
+	CHECK(f != NULL && fgets(buf, sizeof(buf), f) != NULL && strcmp(buf, "/\n") == 0,
+			"working directory");
+	CHECK(f != NULL && pclose_execsp(f) == 0, "pclose");
+	CHECK(system_execsp("test -e /nonexistent") == W_EXITCODE(1, 0), "test status");
+	CHECK(system_execsp("/nonexistent/cmd") == W_EXITCODE(127, 0), "exec failure");
+
+	/* a forked child does not use the server of its parent */
+	if ((pid=fork()) == 0)
+		_exit(system_execsp("sh -c 'exit 4'") == W_EXITCODE(4, 0) ? 0 : 1);
+	CHECK(waitpid(pid, &status, 0) == pid && status == 0, "forked child");
+	CHECK(server_alive(), "stray children");
+
+	execs_server_stop();
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD,
+			"execs_server_stop did not terminate the server");
+	CHECK(system_execsp("true") == 0, "no server");
+	if (errors) {
+		fprintf(stderr, "spawnserver: %d errors\n", errors);
+		return 1;
+	}
+	printf("spawnserver: no errors\n");
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * streams: s2multiargv_fd on mapped files and on pipes
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* a regular file (mapped) and a pipe (read) with the same contents give
+	 the same commands. The parsing starts at the current offset of the file
+	 and moves it to the end of the data used, also when the input is longer
+	 than the unmapped part (1MB) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+/* the number of commands and a checksum of their args */
+struct sum {
+	long ncmd;
+	unsigned long hash;
+	long stop; // f returns 1 at the command number stop
+};
+
+static int sum_f(char **argv, void *opaque) {
+	struct sum *s=opaque;
+	for (; *argv; argv++) {
+		const char *c;
+		for (c=*argv; *c; c++)
+			s->hash=s->hash * 31 + (unsigned char) *c;
+		s->hash=s->hash * 31 + ' ';
+	}
+	return ++s->ncmd == s->stop;
+}
+
+/* the same data through a pipe */
+static int sum_pipe(const char *data, size_t len, struct sum *s) {
+	int pipefd[2];
+	pid_t pid;
+	int rv;
+	if (pipe(pipefd) < 0)
+		return -1;
+	if ((pid=fork()) == 0) {
+		close(pipefd[0]);
+		_exit(write(pipefd[1], data, len) == (ssize_t) len ? 0 : 1);
+	}
+	close(pipefd[1]);
+	rv=s2multiargv_fd(pipefd[0], sum_f, s, 0);
+	close(pipefd[0]);
+	waitpid(pid, NULL, 0);
+	return rv;
+}
+
+int main(int argc, char *argv[]) {
+	char path[]="/tmp/streamsXXXXXX";
+	size_t size=3 * 1024 * 1024;
+	char *data=malloc(size);
+	size_t len=0;
+	long ncmd=0;
+	off_t half;
+	int fd;
+	struct sum ref={0, 0, 0}, new={0, 0, 0};
+	while (len + 64 < size) {
+		len += snprintf(data + len, size - len, "cmd%ld 'a b' c\\ d \"e;f\";", ncmd);
+		ncmd++;
+	}
+	CHECK((fd=mkstemp(path)) >= 0, "mkstemp: %s", strerror(errno));
+	unlink(path);
+	CHECK(write(fd, data, len) == (ssize_t) len, "write");
+
+	lseek(fd, 0, SEEK_SET);
+	CHECK(s2multiargv_fd(fd, sum_f, &new, 0) == 0, "s2multiargv_fd");
+	CHECK(sum_pipe(data, len, &ref) == 0, "s2multiargv_fd (pipe)");
+	CHECK(new.ncmd == ncmd && ref.ncmd == ncmd && new.hash == ref.hash,
+			"file %ld cmds, pipe %ld cmds, expected %ld", new.ncmd, ref.ncmd, ncmd);
+	CHECK(lseek(fd, 0, SEEK_CUR) == (off_t) len, "offset not at the end");
+
+	/* from the current offset (not page aligned) */
+	half=strchr(data + len / 2, ';') + 1 - data;
+	lseek(fd, half, SEEK_SET);
+	new=ref=(struct sum) {0, 0, 0};
+	CHECK(s2multiargv_fd(fd, sum_f, &new, 0) == 0, "s2multiargv_fd (offset)");
+	CHECK(sum_pipe(data + half, len - half, &ref) == 0, "s2multiargv_fd (pipe)");
+	CHECK(new.ncmd == ref.ncmd && new.hash == ref.hash, "different commands from an offset");
+	CHECK(lseek(fd, 0, SEEK_CUR) == (off_t) len, "offset not at the end");
+
+	/* f stops the parsing: the offset is past the data used (as for read) */
+	lseek(fd, 0, SEEK_SET);
+	new=(struct sum) {0, 0, 10};
+	CHECK(s2multiargv_fd(fd, sum_f, &new, 0) == 1 && new.ncmd == 10, "stop");
+	half=lseek(fd, 0, SEEK_CUR);
+	CHECK(half > 0 && half < (off_t) len, "offset %ld after a stop", (long) half);
+	close(fd);
+	free(data);
+	if (errors) {
+		fprintf(stderr, "streams: %d errors\n", errors);
+		return 1;
+	}
+	printf("streams: %ld commands, no errors\n", ncmd);
+	return 0;
+}
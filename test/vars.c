@@ -0,0 +1,188 @@
+/*
+ * vars: the variable store
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* set, replace and remove variables (many of them: the table grows and
+	 entries are removed in the middle of the probe sequences), batches of
+	 definitions. Expansion looks up the store first, then s2argv_getvar;
+	 the store of a context replaces s2argv_vars, compiled commands expand
+	 the current values at each use */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+#define NVARS 5000
+
+struct out {
+	char buf[256];
+	size_t len;
+};
+
+static int out_f(char **argv, void *opaque) {
+	struct out *o=opaque;
+	for (; *argv; argv++)
+		o->len += snprintf(o->buf + o->len, sizeof(o->buf) - o->len, "<%s>", *argv);
+	return 0;
+}
+
+static int out_pipe_f(char **argvv[], void *opaque) {
+	return out_f(argvv[0], opaque);
+}
+
+static char *expand(const char *args) {
+	static char buf[256];
+	char **argv=s2argv(args);
+	size_t len=0;
+	char **arg;
+	*buf=0;
+	if (argv == NULL)
+		return "error";
+	for (arg=argv; *arg; arg++)
+		len += snprintf(buf + len, sizeof(buf) - len, "<%s>", *arg);
+	s2argv_free(argv);
+	return buf;
+}
+
+static char *getvar(const char *name) {
+	static char value[64];
+	snprintf(value, sizeof(value), "getvar:%s", name);
+	return value;
+}
+
+static const char *get(struct execs_vars *v, const char *name) {
+	const char *value=execs_vars_get(v, name);
+	return value ? value : "(null)";
+}
+
+static void test_store(void) {
+	char *defs[]={"A=1", "B=two words", "EMPTY=", "C=x=y", NULL};
+	char *batch[]={"A=one", "B", "D=4", NULL};
+	struct execs_vars *v=execs_vars_new(defs);
+	char name[32], value[32];
+	int i;
+	CHECK(v != NULL, "execs_vars_new: %s", strerror(errno));
+	if (v == NULL)
+		return;
+	CHECK(strcmp(get(v, "A"), "1") == 0 && strcmp(get(v, "B"), "two words") == 0 &&
+			strcmp(get(v, "EMPTY"), "") == 0 && strcmp(get(v, "C"), "x=y") == 0,
+			"definitions");
+	CHECK(execs_vars_get(v, "NONE") == NULL && execs_vars_get(v, "A=1") == NULL, "undefined");
+	CHECK(execs_vars_set(v, "A", "new") == 0 && strcmp(get(v, "A"), "new") == 0, "replace");
+	CHECK(execs_vars_set(v, "A", NULL) == 0 && execs_vars_get(v, "A") == NULL, "remove");
+	CHECK(execs_vars_set(v, "A", NULL) == 0, "remove an undefined variable");
+	errno=0;
+	CHECK(execs_vars_set(v, "", "x") == -1 && errno == EINVAL, "empty name");
+	CHECK(execs_vars_set(v, "A=B", "x") == -1 && errno == EINVAL, "= in the name");
+	CHECK(execs_vars_putv(v, batch) == 0 && strcmp(get(v, "A"), "one") == 0 &&
+			execs_vars_get(v, "B") == NULL && strcmp(get(v, "D"), "4") == 0, "batch");
+	/* the table grows, then the odd variables are removed */
+	for (i=0; i<NVARS; i++) {
+		snprintf(name, sizeof(name), "V%d", i);
+		snprintf(value, sizeof(value), "value%d", i);
+		CHECK(execs_vars_set(v, name, value) == 0, "set %s", name);
+	}
+	for (i=1; i<NVARS; i+=2) {
+		snprintf(name, sizeof(name), "V%d", i);
+		execs_vars_set(v, name, NULL);
+	}
+	for (i=0; i<NVARS; i++) {
+		snprintf(name, sizeof(name), "V%d", i);
+		snprintf(value, sizeof(value), "value%d", i);
+		if (i % 2)
+			CHECK(execs_vars_get(v, name) == NULL, "%s has not been removed", name);
+		else
+			CHECK(strcmp(get(v, name), value) == 0, "%s: %s", name, get(v, name));
+	}
+	CHECK(strcmp(get(v, "D"), "4") == 0 && strcmp(get(v, "C"), "x=y") == 0, "old variables");
+	execs_vars_free(v);
+	execs_vars_free(NULL);
+}
+
+static void test_expansion(void) {
+	char *defs[]={"A=1", "B=two words", NULL};
+	char *ctxdefs[]={"A=ctx", NULL};
+	struct execs_vars *v=execs_vars_new(defs);
+	struct execs_vars *cv=execs_vars_new(ctxdefs);
+	struct execs_ctx ctx;
+	struct execs_capture cap={NULL, 0, 0, 0};
+	struct s2argv_compiled *t;
+	struct out o={"", 0};
+	s2argv_vars=v;
+	s2argv_getvar=NULL;
+	CHECK(strcmp(expand("x $A $B '$A' \\$A $C"), "<x><1><two words><$A><$A><>") == 0,
+			"store: %s", expand("x $A $B '$A' \\$A $C"));
+	s2argv_getvar=getvar;
+	CHECK(strcmp(expand("$A $C"), "<1><getvar:C>") == 0, "store, then getvar: %s",
+			expand("$A $C"));
+	/* a value is a single argument */
+	CHECK(system_execsp_capture("sh -c 'echo $#' sh $B", &cap) == 0 &&
+			strcmp(cap.buf, "1\n") == 0, "system: \"%s\"", cap.buf);
+	execs_capture_free(&cap);
+	/* the store of the context */
+	execs_ctx_init(&ctx);
+	ctx.vars=cv;
+	CHECK(_s2multipipe_ctx(&ctx, "$A $B", out_pipe_f, &o, 0) == 0 &&
+			strcmp(o.buf, "<ctx><getvar:B>") == 0, "context: %s", o.buf);
+	/* compiled commands: the current values */
+	t=s2argv_compile("echo $A", 0);
+	CHECK(t != NULL, "s2argv_compile: %s", strerror(errno));
+	if (t) {
+		o.len=0;
+		execs_vars_set(v, "A", "first");
+		s2multiargv_compiled(t, out_f, &o);
+		execs_vars_set(v, "A", "second");
+		s2multiargv_compiled(t, out_f, &o);
+		CHECK(strcmp(o.buf, "<echo><first><echo><second>") == 0, "compiled: %s", o.buf);
+		s2argv_compiled_free(t);
+	}
+	errno=0;
+	CHECK(_system_common(NULL, "echo $A", NULL, EXECS_NOSEQ | EXECS_NOVAR) == W_EXITCODE(127, 0) &&
+			errno == EINVAL, "EXECS_NOVAR");
+	s2argv_vars=NULL;
+	s2argv_getvar=NULL;
+	execs_vars_free(v);
+	execs_vars_free(cv);
+}
+
+int main(int argc, char *argv[]) {
+	test_store();
+	test_expansion();
+	if (errors) {
+		fprintf(stderr, "vars: %d errors\n", errors);
+		return 1;
+	}
+	printf("vars: no errors\n");
+	return 0;
+}
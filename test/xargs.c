@@ -0,0 +1,157 @@
+/*
+ * xargs: argument batching within ARG_MAX
+ * Copyright (C) 2014-2023 Renzo Davoli. University of Bologna. <renzo@cs.unibo.it>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* arguments whose total size is several times ARG_MAX: all of them are
+	 used (no E2BIG), in as few batches as the limit allows, sequentially or
+	 concurrently. Each batch appends its number of arguments to a file in
+	 a temporary directory */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <execs.h>
+
+static int errors;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		errors++; \
+	} \
+} while (0)
+
+#define COUNT "sh -c 'echo $#' sh >>count"
+
+/* the number of batches and of arguments listed in count */
+static long batches(long *nargs) {
+	FILE *f=fopen("count", "r");
+	long n=0, count;
+	*nargs=0;
+	if (f == NULL)
+		return 0;
+	while (fscanf(f, "%ld", &count) == 1) {
+		*nargs += count;
+		n++;
+	}
+	fclose(f);
+	unlink("count");
+	return n;
+}
+
+static void test_batches(char **args, long nargs, size_t total, int maxjobs) {
+	long argmax=sysconf(_SC_ARG_MAX);
+	long n, used;
+	/* at least half of ARG_MAX for each batch */
+	long maxbatches=total / (argmax / 2) + 1;
+	CHECK(system_execsp_xargs(COUNT, args, maxjobs) == 0, "maxjobs %d: %s", maxjobs, strerror(errno));
+	n=batches(&used);
+	CHECK(used == nargs, "maxjobs %d: %ld arguments used, %ld expected", maxjobs, used, nargs);
+	CHECK(n > 1 && n <= maxbatches, "maxjobs %d: %ld batches (ARG_MAX %ld, %zu bytes)",
+			maxjobs, n, argmax, total);
+}
+
+static void test_stream(void) {
+	char items[]="a b\nc\n\nd";
+	char zitems[]="x\0y z\0";
+	char buf[64];
+	FILE *f;
+	ssize_t n;
+	int fd;
+	const char *print="sh -c 'printf \"<%s>\" \"$@\"' sh >>out";
+	f=fmemopen(items, strlen(items), "r");
+	CHECK(system_execsp_xargs_stream(print, f, '\n', 1) == 0, "stream");
+	fclose(f);
+	f=fmemopen(zitems, sizeof(zitems) - 1, "r");
+	CHECK(system_execsp_xargs_stream(print, f, '\0', 1) == 0, "stream (NUL)");
+	fclose(f);
+	fd=open("out", O_RDONLY);
+	n=read(fd, buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0]=0;
+	close(fd);
+	unlink("out");
+	CHECK(strcmp(buf, "<a b><c><><d><x><y z>") == 0, "stream items: \"%s\"", buf);
+}
+
+static void test_errors(void) {
+	char *none[]={NULL};
+	char *two[]={"a", "b", NULL};
+	char *huge[]={"a", NULL, NULL};
+	long used;
+	size_t hugelen=64 * sysconf(_SC_PAGESIZE);
+	/* no arguments: nothing runs */
+	CHECK(system_execsp_xargs(COUNT, none, 1) == 0 && batches(&used) == 0, "no arguments");
+	CHECK(system_execsp_xargs("sh -c 'exit 3'", two, 1) == W_EXITCODE(3, 0), "failure");
+	errno=0;
+	CHECK(system_execsp_xargs(COUNT, NULL, 1) == -1 && errno == EINVAL, "NULL args");
+	CHECK(system_execsp_xargs("true; true", two, 1) == W_EXITCODE(127, 0), "sequence");
+	/* longer than the limit of a single argument */
+	huge[1]=malloc(hugelen + 1);
+	memset(huge[1], 'x', hugelen);
+	huge[1][hugelen]=0;
+	errno=0;
+	CHECK(system_execsp_xargs(COUNT, huge, 1) == -1 && errno == E2BIG, "huge argument");
+	free(huge[1]);
+	batches(&used);
+}
+
+int main(int argc, char *argv[]) {
+	char dir[]="/tmp/xargsXXXXXX";
+	char rm[64];
+	long argmax=sysconf(_SC_ARG_MAX);
+	/* about 4 times ARG_MAX */
+	long nargs=4 * argmax / (32 + sizeof(char *));
+	char **args=calloc(nargs + 1, sizeof(char *));
+	char *buf=malloc(nargs * 32);
+	size_t total=0;
+	long i;
+	if (args == NULL || buf == NULL)
+		return perror("xargs"), 1;
+	if (mkdtemp(dir) == NULL || chdir(dir) < 0)
+		return perror("xargs"), 1;
+	for (i=0; i<nargs; i++) {
+		args[i]=buf + i * 32;
+		snprintf(args[i], 32, "argument-%022ld", i);
+		total += strlen(args[i]) + 1 + sizeof(char *);
+	}
+	test_batches(args, nargs, total, 1);
+	test_batches(args, nargs, total, 4);
+	test_stream();
+	test_errors();
+	free(args);
+	free(buf);
+	errno=0;
+	CHECK(waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD, "stray children");
+	if (chdir("/") == 0) {
+		snprintf(rm, sizeof(rm), "rm -rf %s", dir);
+		system_execsp(rm);
+	}
+	if (errors) {
+		fprintf(stderr, "xargs: %d errors\n", errors);
+		return 1;
+	}
+	printf("xargs: %ld arguments, no errors\n", nargs);
+	return 0;
+}